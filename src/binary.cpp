@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstring>
+
+#include "data.h"
+
+#include "binary.h"
+
+BinaryInput::BinaryInput(std::string const & filename, char const * magic):
+    filename_(filename) {
+    if (not input_.open(filename))
+        throw STR("Unable to open binary file " << filename);
+    size_t length = strlen(magic);
+    std::string header(length, '\0');
+    if (input_.read(& header[0], length) != length or memcmp(header.data(), magic, length) != 0)
+        throw STR("File " << filename << " is not a binary file of expected type or version");
+}
+
+uint64_t BinaryInput::varint() {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        char c;
+        if (not input_.get(c))
+            throw STR("Unexpected end of binary file " << filename_);
+        uint8_t b = static_cast<uint8_t>(c);
+        result |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return result;
+    }
+    throw STR("Invalid varint in binary file " << filename_);
+}
+
+uint32_t BinaryInput::fixed32() {
+    char buffer[4];
+    read(buffer, 4);
+    uint32_t result = 0;
+    for (unsigned i = 0; i < 4; ++i)
+        result |= static_cast<uint32_t>(static_cast<uint8_t>(buffer[i])) << (i * 8);
+    return result;
+}
+
+uint64_t BinaryInput::fixed64() {
+    char buffer[8];
+    read(buffer, 8);
+    uint64_t result = 0;
+    for (unsigned i = 0; i < 8; ++i)
+        result |= static_cast<uint64_t>(static_cast<uint8_t>(buffer[i])) << (i * 8);
+    return result;
+}
+
+Digest BinaryInput::digest() {
+    Digest result;
+    read(reinterpret_cast<char *>(result.bytes), Digest::Bytes);
+    return result;
+}
+
+void BinaryInput::bytes(size_t size, std::string & into) {
+    into.clear();
+    // read in pieces, so that a corrupted size fails at the end of the file instead of allocating the whole size first
+    char piece[4096];
+    while (size > 0) {
+        size_t n = std::min(size, sizeof(piece));
+        read(piece, n);
+        into.append(piece, n);
+        size -= n;
+    }
+}
+
+void BinaryInput::skipTo(uint64_t offset) {
+    uint64_t pos = input_.offset();
+    if (offset < pos)
+        throw STR("Offset " << offset << " before the read position " << pos << " in binary file " << filename_);
+    if (input_.skip(offset - pos) != offset - pos)
+        throw STR("Unexpected end of binary file " << filename_);
+}
+
+bool TokensReader::next(unsigned & fid, TokenIds & ids) {
+    if (input_.eof())
+        return false;
+    fid = input_.varint();
+    size_t n = input_.varint();
+    ids.freqs_.clear();
+    ids.freqs_.reserve(n);
+    uint32_t id = 0;
+    for (size_t i = 0; i < n; ++i) {
+        id += input_.varint();
+        uint32_t freq = input_.varint();
+        ids.freqs_.push_back(std::make_pair(id, freq));
+    }
+    return true;
+}
+
+bool DictionaryReader::next(unsigned & id, unsigned & count, std::string & token) {
+    if (input_.eof())
+        return false;
+    id = input_.varint();
+    count = input_.varint();
+    input_.bytes(input_.varint(), token);
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "utils.h"
+#include "config.h"
+#include "input.h"
+#include "hashes/hash.h"
+
+class TokenIds;
+
+/** Reader of the binary output files.
+
+  Streams the file through an InputBuffer, so that only a chunk of it is in memory at a time, and checks its magic. All numbers are little endian, variable width numbers are base 128 varints. Reading past the end of the file throws.
+ */
+class BinaryInput {
+public:
+    /** Opens given file and checks that it starts with given 8 character magic.
+     */
+    BinaryInput(std::string const & filename, char const * magic);
+
+    bool eof() {
+        return input_.eof();
+    }
+
+    /** Offset of the next byte to be read.
+     */
+    uint64_t offset() const {
+        return input_.offset();
+    }
+
+    uint64_t varint();
+
+    uint32_t fixed32();
+
+    uint64_t fixed64();
+
+    Digest digest();
+
+    /** Reads given number of bytes into the string.
+     */
+    void bytes(size_t size, std::string & into);
+
+    /** Moves the read position forward to given offset.
+
+      The file is read sequentially, so the offset must not be before the read position, as is the case for the offsets of the paths, which are written in order.
+     */
+    void skipTo(uint64_t offset);
+
+private:
+    /** Reads exactly given number of bytes, throws at the end of the file.
+     */
+    void read(char * into, size_t size) {
+        if (input_.read(into, size) != size)
+            throw STR("Unexpected end of binary file " << filename_);
+    }
+
+    std::string filename_;
+    InputBuffer input_;
+};
+
+/** Reads the token ids and their frequencies of files from binary tokens file.
+
+  Each record holds the file id, number of unique tokens, and the pairs of token id and frequency ordered by token id. The token ids are delta encoded.
+ */
+class TokensReader {
+public:
+    TokensReader(std::string const & filename):
+        input_(filename, TOKENS_BINARY_MAGIC) {
+    }
+
+    /** Reads next record into given file id and token ids. Returns false if there are no more records.
+     */
+    bool next(unsigned & fid, TokenIds & ids);
+
+private:
+    BinaryInput input_;
+};
+
+/** Reads the global token dictionary from its binary file.
+
+  Each record holds the token id, its total frequency and the raw token.
+ */
+class DictionaryReader {
+public:
+    DictionaryReader(std::string const & filename):
+        input_(filename, GLOBAL_TOKENS_BINARY_MAGIC) {
+    }
+
+    /** Reads next token. Returns false if there are no more tokens.
+     */
+    bool next(unsigned & id, unsigned & count, std::string & token);
+
+private:
+    BinaryInput input_;
+};
@@ -0,0 +1,90 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "buffer.h"
+
+size_t FileBuffer::mmapThreshold_ = 128 * 1024;
+
+FileBuffer & FileBuffer::operator = (FileBuffer && other) {
+    if (this == & other)
+        return *this;
+    clear();
+    mapped_ = other.mapped_;
+    size_ = other.size_;
+    if (mapped_) {
+        data_ = other.data_;
+    } else {
+        // the string may keep short contents inline, so the pointer must be taken after the move
+        owned_ = std::move(other.owned_);
+        data_ = & owned_[0];
+    }
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapped_ = false;
+    other.owned_.clear();
+    return *this;
+}
+
+bool FileBuffer::load(std::string const & filename) {
+    clear();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool result = load(fd);
+    close(fd);
+    return result;
+}
+
+bool FileBuffer::load(int fd) {
+    clear();
+    struct stat s;
+    if (fstat(fd, &s) != 0 or S_ISDIR(s.st_mode))
+        return false;
+    size_t size = s.st_size;
+    if (size > 0 and size >= mmapThreshold_) {
+        void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, size, MADV_SEQUENTIAL);
+            data_ = static_cast<char *>(p);
+            size_ = size;
+            mapped_ = true;
+            return true;
+        }
+        // if the file cannot be mapped, read it instead
+    }
+    owned_.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t r = read(fd, & owned_[done], size - done);
+        if (r < 0 and errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        done += r;
+    }
+    owned_.resize(done);
+    data_ = & owned_[0];
+    size_ = done;
+    return true;
+}
+
+void FileBuffer::assign(std::string && contents) {
+    clear();
+    owned_ = std::move(contents);
+    data_ = & owned_[0];
+    size_ = owned_.size();
+}
+
+void FileBuffer::clear() {
+    if (mapped_)
+        munmap(data_, size_);
+    else
+        std::string().swap(owned_);
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+
+/** Contents of a file loaded into memory.
+
+  Small files are read into an owned buffer, files at least MmapThreshold() bytes large are memory mapped and advised for sequential access instead. The mapping is private, so that tokenizers may normalize the contents in place without ever touching the file itself.
+
+  The buffer may also own arbitrary contents, such as files converted from other encodings.
+ */
+class FileBuffer {
+public:
+    FileBuffer():
+        data_(nullptr),
+        size_(0),
+        mapped_(false) {
+    }
+
+    FileBuffer(FileBuffer const &) = delete;
+    FileBuffer & operator = (FileBuffer const &) = delete;
+
+    FileBuffer(FileBuffer && other):
+        data_(nullptr),
+        size_(0),
+        mapped_(false) {
+        *this = std::move(other);
+    }
+
+    FileBuffer & operator = (FileBuffer && other);
+
+    ~FileBuffer() {
+        clear();
+    }
+
+    /** Loads contents of the given file, replacing any previous contents.
+
+      Returns false if the file cannot be opened.
+     */
+    bool load(std::string const & filename);
+
+    /** Loads contents of the already opened file, replacing any previous contents. The descriptor is not closed.
+
+      Returns false if the descriptor does not refer to a file that can be loaded.
+     */
+    bool load(int fd);
+
+    /** Replaces the contents with the given string.
+     */
+    void assign(std::string && contents);
+
+    /** Releases the contents.
+     */
+    void clear();
+
+    char const * data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    char operator [] (size_t index) const {
+        return data_[index];
+    }
+
+    char & operator [] (size_t index) {
+        return data_[index];
+    }
+
+    bool operator == (FileBuffer const & other) const {
+        return size_ == other.size_ and memcmp(data_, other.data_, size_) == 0;
+    }
+
+    bool operator != (FileBuffer const & other) const {
+        return not (*this == other);
+    }
+
+    /** Files of this size in bytes or larger are memory mapped, smaller files are read.
+
+      Defaults to 128 KB, set in KB by --mmap-threshold. Where mapping beats reading depends on the machine and file system, so it is worth measuring on the machine doing the run.
+     */
+    static size_t & MmapThreshold() {
+        return mmapThreshold_;
+    }
+
+private:
+    char * data_;
+    size_t size_;
+    bool mapped_;
+    std::string owned_;
+
+    static size_t mmapThreshold_;
+};
@@ -0,0 +1,94 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "merger.h"
+#include "writer.h"
+#include "manifest.h"
+
+#include "checkpoint.h"
+
+unsigned Checkpoint::interval_ = 0;
+unsigned Checkpoint::number_ = 0;
+
+void Checkpoint::Take(std::string const & outputDir) {
+    // the mergers finish their jobs and schedule the merged files, which the writers then write
+    Merger::Pause();
+    while (not Merger::Paused() or not Writer::Statistic().finished())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    unsigned number = number_ + 1;
+    std::string dir = STR(outputDir << "/" << PATH_CHECKPOINT);
+    std::string filename = STR(dir << "/" << CHECKPOINT_FILE << CHECKPOINT_FILE_EXT);
+    OutputBuffer f;
+    f.open(filename + ".tmp");
+    f << number << '\n';
+    auto record = [& f, & outputDir] (std::string const & file, uint64_t size) {
+        f << size << "," << escapePath(file.substr(outputDir.size() + 1)) << '\n';
+    };
+    try {
+        Writer::Sync(record);
+        Manifest::Sync(record);
+        OutputBuffer tokens;
+        tokens.open(TokensFile(outputDir, number));
+        Merger::writeGlobalTokensBinary(tokens);
+        tokens.sync();
+    } catch (...) {
+        Merger::Resume();
+        throw;
+    }
+    Merger::Resume();
+    f.sync();
+    f.close();
+    // the new checkpoint replaces the old one only once it is complete
+    if (rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+        throw STR("Unable to write checkpoint " << filename);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    if (number_ > 0)
+        unlink(TokensFile(outputDir, number_).c_str());
+    number_ = number;
+}
+
+void Checkpoint::Restore(std::string const & outputDir) {
+    std::string filename = STR(outputDir << "/" << PATH_CHECKPOINT << "/" << CHECKPOINT_FILE << CHECKPOINT_FILE_EXT);
+    FileBuffer f;
+    if (not f.load(filename))
+        throw STR("No checkpoint to resume from found in " << outputDir);
+    bool first = true;
+    forEachLine(f, [& first, & outputDir] (std::string const & line) {
+        if (first) {
+            number_ = std::stoul(line);
+            first = false;
+            return;
+        }
+        // size, path relative to the output directory
+        std::vector<std::string> items(split(line, ','));
+        if (items.size() != 2)
+            throw STR("Invalid line format of checkpoint: " << line);
+        std::string file = STR(outputDir << "/" << unescapePath(items[1]));
+        uint64_t size = std::stoull(items[0]);
+        struct stat s;
+        if (stat(file.c_str(), & s) != 0 or static_cast<uint64_t>(s.st_size) < size)
+            throw STR("File " << file << " is missing data from the checkpoint");
+        if (truncate(file.c_str(), size) != 0)
+            throw STR("Unable to restore file " << file << " to the checkpoint");
+    });
+    Merger::LoadGlobalTokens(STR(outputDir << "/" << PATH_CHECKPOINT << "/" << CHECKPOINT_TOKENS_FILE << number_));
+}
+
+void Checkpoint::Remove(std::string const & outputDir) {
+    // without the checkpoint file, the tokens file is never used
+    unlink(STR(outputDir << "/" << PATH_CHECKPOINT << "/" << CHECKPOINT_FILE << CHECKPOINT_FILE_EXT).c_str());
+    if (number_ > 0)
+        unlink(TokensFile(outputDir, number_).c_str());
+}
+
+std::string Checkpoint::TokensFile(std::string const & outputDir, unsigned number) {
+    return STR(outputDir << "/" << PATH_CHECKPOINT << "/" << CHECKPOINT_TOKENS_FILE << number << BINARY_EXT);
+}
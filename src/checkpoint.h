@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+/** Periodic checkpoints of a tokenize run, from which an interrupted run can be resumed, see PATH_CHECKPOINT.
+
+  A checkpoint is taken at a quiescent point of the pipeline: the mergers are paused, and once the writers have written all files merged so far, all output files are synced to disk and their sizes are recorded together with the token dictionary and counts of the mergers. The stages before the mergers keep working until their queues fill up. The checkpoint file is replaced atomically, so a crash while a checkpoint is being taken leaves the previous one intact.
+
+  Resuming truncates all output files to their sizes at the last checkpoint, which drops whatever was written after it, restores the token dictionary and then continues as an incremental run (see Manifest) with the same inputs. Projects and files written before the checkpoint are skipped, and new file and project ids continue after those in the output, so that no id is used twice.
+ */
+class Checkpoint {
+public:
+    /** Seconds between checkpoints, 0 (the default) disables them.
+     */
+    static unsigned & Interval() {
+        return interval_;
+    }
+
+    /** Takes a checkpoint of the output in given directory.
+
+      Must be called by the thread driving the pipeline, while the workers are running.
+     */
+    static void Take(std::string const & outputDir);
+
+    /** Restores the output in given directory to its last checkpoint and loads the token dictionary of the checkpoint. The manifest must be loaded afterwards.
+
+      Throws if there is no checkpoint.
+     */
+    static void Restore(std::string const & outputDir);
+
+    /** Removes the checkpoint once the run is complete, since the output can no longer be restored to it.
+     */
+    static void Remove(std::string const & outputDir);
+
+private:
+    static std::string TokensFile(std::string const & outputDir, unsigned number);
+
+    static unsigned interval_;
+
+    /** Number of the last checkpoint, continued by resumed runs.
+     */
+    static unsigned number_;
+};
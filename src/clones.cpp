@@ -0,0 +1,39 @@
+#include "clones.h"
+
+void CloneIndex::Shard::grow() {
+    std::vector<Entry> old(entries.size() == 0 ? INITIAL_CAPACITY : entries.size() * 2);
+    old.swap(entries);
+    size_t mask = entries.size() - 1;
+    for (Entry const & e : old) {
+        if (e.fid == 0)
+            continue;
+        size_t i = slot(e.digest) & mask;
+        while (entries[i].fid != 0)
+            i = (i + 1) & mask;
+        entries[i] = e;
+    }
+}
+
+bool CloneIndex::insert(Digest const & digest, unsigned pid, unsigned fid, unsigned & originalPid, unsigned & originalFid) {
+    Shard & s = shards_[digest.hash() % NUM_SHARDS];
+    std::lock_guard<std::mutex> g(s.m);
+    // keep the load factor at most 3/4
+    if ((s.size + 1) * 4 > s.entries.size() * 3)
+        s.grow();
+    size_t mask = s.entries.size() - 1;
+    size_t i = slot(digest) & mask;
+    while (s.entries[i].fid != 0) {
+        if (s.entries[i].digest == digest) {
+            originalPid = s.entries[i].pid;
+            originalFid = s.entries[i].fid;
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    s.entries[i].digest = digest;
+    s.entries[i].pid = pid;
+    s.entries[i].fid = fid;
+    ++s.size;
+    ++size_;
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "hashes/hash.h"
+
+/** Concurrent index of file digests used for clone detection.
+
+  Maps each digest to the project and file ids of the first file seen with it. The index is split into shards by the digest, each guarded by its own mutex, so that merger threads checking different files rarely wait for each other.
+
+  Each shard is an open addressing table with linear probing whose entries hold the binary digest and both ids inline, i.e. 24 bytes per file with no further allocations. Since file ids start at FILE_ID_STARTS_AT, entries with fid 0 are empty.
+ */
+class CloneIndex {
+public:
+    static constexpr unsigned NUM_SHARDS = 256;
+
+    CloneIndex():
+        size_(0) {
+    }
+
+    /** Adds the digest with given ids to the index and returns true, unless the digest is already present, in which case returns false and the ids of the file it belongs to in originalPid and originalFid.
+     */
+    bool insert(Digest const & digest, unsigned pid, unsigned fid, unsigned & originalPid, unsigned & originalFid);
+
+    /** Number of unique digests in the index.
+     */
+    unsigned size() const {
+        return size_;
+    }
+
+private:
+    static constexpr unsigned INITIAL_CAPACITY = 64;
+
+    struct Entry {
+        Digest digest;
+        unsigned pid;
+        unsigned fid;
+
+        Entry():
+            pid(0),
+            fid(0) {
+        }
+    };
+
+    struct Shard {
+        std::mutex m;
+        std::vector<Entry> entries;
+        size_t size = 0;
+
+        /** Doubles the capacity of the table.
+         */
+        void grow();
+    };
+
+    /** Position of the digest in a shard's table.
+
+      Uses different bytes than the shard selection, so that digests in the same shard are still spread over the whole table.
+     */
+    static size_t slot(Digest const & digest) {
+        size_t result;
+        memcpy(& result, digest.bytes + Digest::Bytes - sizeof(result), sizeof(result));
+        return result;
+    }
+
+    Shard shards_[NUM_SHARDS];
+
+    std::atomic_uint size_;
+};
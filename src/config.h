@@ -38,3 +38,60 @@
 
 #define FULL_STATS_FILE "stats-full-"
 #define FULL_STATS_FILE_EXT ".txt"
+
+/** The global token dictionary, written into the output directory itself.
+ */
+#define GLOBAL_TOKENS_FILE "tokens"
+#define GLOBAL_TOKENS_FILE_EXT ".txt"
+
+/** Binary output.
+
+  Binary output files have the same names as their text counterparts, but the binary extension. The relative paths of the files in the full stats are kept in a separate file next to the stats, so that the stats records have fixed width. Each binary file starts with its magic, which also encodes the version of the format.
+ */
+#define BINARY_EXT ".bin"
+
+#define FULL_STATS_PATHS_FILE "paths-full-"
+
+#define TOKENS_BINARY_MAGIC "JSTOKS01"
+#define FULL_STATS_BINARY_MAGIC "JSSTAT01"
+#define FULL_STATS_PATHS_BINARY_MAGIC "JSPATH01"
+#define GLOBAL_TOKENS_BINARY_MAGIC "JSDICT01"
+
+/** List of projects to tokenize instead of crawling directories, see Crawler.
+
+  The text format has one project per line, its path and the URL of its origin separated by a comma, both escaped like the paths in the output. The binary format starts with its magic, followed by the path and the URL of each project, each as its length in a varint and its bytes.
+ */
+#define PROJECTS_BINARY_MAGIC "JSPRJS01"
+
+/** Extension appended to the names of compressed output files.
+ */
+#define COMPRESSED_EXT ".gz"
+
+/** Cached file histories of projects, one file per project named by the MD5 of its path.
+
+  The first line is the HEAD the history was computed for, each further line holds the author time and path of an added file.
+ */
+#define HISTORY_CACHE_EXT ".history"
+
+/** Manifest of the output, which allows incremental runs to only add new and changed files to existing output.
+
+  Each writer shard records the project and file ids, whether the file was an original or a clone, the hash of its contents as read, its clone detection digest and its relative path. The heads file records the HEAD at which each project was read once all its files were written, the last record of a project being the current one. Project paths are taken from the bookkeeping files.
+ */
+#define PATH_MANIFEST "manifest"
+
+#define MANIFEST_FILE "manifest-"
+#define MANIFEST_FILE_EXT ".txt"
+
+#define MANIFEST_HEADS_FILE "heads"
+#define MANIFEST_HEADS_FILE_EXT ".txt"
+
+/** Checkpoints of a tokenize run, see Checkpoint.
+
+  The checkpoint file holds the number of the checkpoint on its first line, followed by the size and the path relative to the output directory of each output file, one per line. The token dictionary and counts at the checkpoint are stored in the binary global tokens format, in the tokens file suffixed with the number of the checkpoint.
+ */
+#define PATH_CHECKPOINT "checkpoint"
+
+#define CHECKPOINT_FILE "checkpoint"
+#define CHECKPOINT_FILE_EXT ".txt"
+
+#define CHECKPOINT_TOKENS_FILE "tokens-"
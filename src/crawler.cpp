@@ -1,11 +1,73 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dirent.h>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 #include <thread>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "hashes/murmur3.h"
+
 #include "crawler.h"
-#include "tokenizer.h"
+#include "reader.h"
+
+std::atomic_uint OpenDirectory::open_(0);
+
+unsigned Crawler::shard_ = 0;
+unsigned Crawler::numShards_ = 1;
+
+OpenDirectory::~OpenDirectory() {
+    close(fd);
+    --open_;
+}
+
+namespace {
+
+#ifdef __linux__
+    /** Directory entry as returned by getdents64, which glibc does not declare.
+     */
+    struct Dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+#endif
+
+    /** Returns true if the entry is a directory to crawl, i.e. neither . nor .., stat'ing it only if the file system did not report its type.
+     */
+    bool isSubdirectory(int fd, char const * name, unsigned char type) {
+        if (name[0] == '.' and (name[1] == 0 or (name[1] == '.' and name[2] == 0)))
+            return false;
+        if (type != DT_UNKNOWN)
+            return type == DT_DIR;
+        struct stat s;
+        return fstatat(fd, name, & s, AT_SYMLINK_NOFOLLOW) == 0 and S_ISDIR(s.st_mode);
+    }
 
+    /** Reads a varint from the stream. Returns false at the end of the stream.
+     */
+    bool readVarint(std::istream & s, uint64_t & value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            int c = s.get();
+            if (c == EOF)
+                return false;
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+}
 
 void Crawler::initializeWorkers(unsigned num) {
     for (unsigned i = 0; i < num; ++i) {
@@ -18,39 +80,159 @@ void Crawler::initializeWorkers(unsigned num) {
 }
 
 
+void Crawler::SetShard(std::string const & spec) {
+    size_t slash = spec.find('/');
+    if (slash == std::string::npos)
+        throw STR("Invalid shard " << spec << ", expected index/count");
+    shard_ = std::stoul(spec.substr(0, slash));
+    numShards_ = std::stoul(spec.substr(slash + 1));
+    if (numShards_ == 0 or shard_ >= numShards_)
+        throw STR("Invalid shard " << spec << ", expected index/count");
+}
+
 void Crawler::process(CrawlerJob const & job) {
-    std::string url = projectUrl(job.path);
-    // if the directory is not empty, create job for the tokenizer
-    if (not url.empty()) {
-        Tokenizer::Schedule(TokenizerJob(job.path, url));
-    // otherwise recursively scan all its subdirectories
-    } else {
-        struct dirent * ent;
-        DIR * d = opendir(job.path.c_str());
-        assert(d != nullptr);
-        while ((ent = readdir(d)) != nullptr) {
-            // if it is file or symlink, ignore
-            if (ent->d_type == DT_REG or ent->d_type == DT_LNK)
-                continue;
-            // skip . and ..
-            if (strcmp(ent->d_name, ".") == 0 or strcmp(ent->d_name, "..") == 0)
-                continue;
+    if (job.projectsFile) {
+        readProjectsFile(job.path);
+        return;
+    }
+    int fd = job.parent == nullptr
+        ? open(job.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+        : openat(job.parent->fd, job.name(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        throw STR("Unable to open directory " << job.path);
+    // subdirectories are local since scheduling them may crawl them right away when the queue is full
+    std::vector<std::string> subdirs;
+    bool git;
+    try {
+        git = listDirectory(fd, job, subdirs);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    // if the directory is a git project, create job for the reader
+    if (git) {
+        std::string url = projectUrl(fd);
+        if (not url.empty()) {
+            close(fd);
+            ScheduleProject(job.path, url);
+            return;
+        }
+    }
+    // otherwise recursively scan all its subdirectories, relative to the directory unless too many are open already
+    std::shared_ptr<OpenDirectory> dir;
+    if (not subdirs.empty() and OpenDirectory::NumOpen() < MAX_OPEN_DIRECTORIES)
+        dir = std::make_shared<OpenDirectory>(fd);
+    else
+        close(fd);
+    for (std::string const & name : subdirs)
+        schedule(CrawlerJob(job.path + "/" + name, dir));
+}
+
+bool Crawler::listDirectory(int fd, CrawlerJob const & job, std::vector<std::string> & subdirs) {
+    bool git = false;
+#ifdef __linux__
+    if (entries_ == nullptr)
+        entries_.reset(new char[ENTRIES_BUFFER_SIZE]);
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, entries_.get(), ENTRIES_BUFFER_SIZE);
+        if (n < 0)
+            throw STR("Unable to list directory " << job.path);
+        if (n == 0)
+            break;
+        for (long i = 0; i < n; ) {
+            Dirent64 const * ent = reinterpret_cast<Dirent64 const *>(entries_.get() + i);
+            i += ent->d_reclen;
             // skip .git as we do not crawl it
             if (strcmp(ent->d_name, ".git") == 0)
+                git = true;
+            else if (isSubdirectory(fd, ent->d_name, ent->d_type))
+                subdirs.push_back(ent->d_name);
+        }
+    }
+#else
+    // the directory stream takes over its descriptor, which the caller still needs
+    DIR * d = fdopendir(dup(fd));
+    if (d == nullptr)
+        throw STR("Unable to list directory " << job.path);
+    struct dirent * ent;
+    while ((ent = readdir(d)) != nullptr) {
+        if (strcmp(ent->d_name, ".git") == 0)
+            git = true;
+        else if (isSubdirectory(fd, ent->d_name, ent->d_type))
+            subdirs.push_back(ent->d_name);
+    }
+    closedir(d);
+#endif
+    return git;
+}
+
+void Crawler::readProjectsFile(std::string const & filename) {
+    std::ifstream s(filename, std::ios::binary);
+    if (not s.good())
+        throw STR("Unable to open projects file " << filename);
+    char magic[sizeof(PROJECTS_BINARY_MAGIC) - 1];
+    s.read(magic, sizeof(magic));
+    if (s.gcount() == sizeof(magic) and memcmp(magic, PROJECTS_BINARY_MAGIC, sizeof(magic)) == 0) {
+        std::string path;
+        std::string url;
+        uint64_t size;
+        while (readVarint(s, size)) {
+            path.resize(size);
+            s.read(& path[0], size);
+            if (not readVarint(s, size))
+                throw STR("Unexpected end of projects file " << filename);
+            url.resize(size);
+            s.read(& url[0], size);
+            if (not s.good())
+                throw STR("Unexpected end of projects file " << filename);
+            ScheduleProject(path, url);
+        }
+    } else {
+        s.clear();
+        s.seekg(0);
+        std::string line;
+        while (std::getline(s, line)) {
+            // projects files written on Windows end their lines with \r\n
+            if (not line.empty() and line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
                 continue;
-            // crawl the directory recursively
-            schedule(CrawlerJob(job.path + "/" + ent->d_name));
+            // path, url
+            std::vector<std::string> items(split(line, ','));
+            if (items.size() != 2)
+                throw STR("Invalid line format of projects file: " << line);
+            ScheduleProject(unescapePath(items[0]), unescapePath(items[1]));
         }
-        closedir(d);
     }
 }
 
-std::string Crawler::projectUrl(std::string const & path) {
-    std::ifstream x(path + "/.git/config");
+void Crawler::ScheduleProject(std::string const & path, std::string const & url) {
+    if (numShards_ > 1) {
+        Murmur3 h;
+        h.add(path.c_str(), path.size());
+        unsigned char hash[Murmur3::HashBytes];
+        h.getHash(hash);
+        uint64_t x;
+        memcpy(& x, hash, sizeof(x));
+        if (x % numShards_ != shard_)
+            return;
+    }
+    Reader::Schedule(ReaderJob(path, url));
+}
+
+std::string Crawler::projectUrl(int fd) {
+    int config = openat(fd, ".git/config", O_RDONLY | O_CLOEXEC);
     // if not found, it is not git repository
-    if (not x.good())
+    if (config < 0)
         return "";
+    std::string contents;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(config, buffer, sizeof(buffer))) > 0)
+        contents.append(buffer, n);
+    close(config);
     // parse the config file
+    std::istringstream x(contents);
     std::string l;
     while (not x.eof()) {
         x >> l;
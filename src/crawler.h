@@ -1,14 +1,69 @@
 #pragma once
+#include <memory>
+
 #include "worker.h"
 
 
+/** Directory kept open so that its subdirectories can be opened relative to it, closed when the last of them is done.
+ */
+class OpenDirectory {
+public:
+    OpenDirectory(int fd):
+        fd(fd) {
+        ++open_;
+    }
+
+    OpenDirectory(OpenDirectory const &) = delete;
+    OpenDirectory & operator = (OpenDirectory const &) = delete;
+
+    ~OpenDirectory();
+
+    /** Number of directories kept open by all crawlers.
+     */
+    static unsigned NumOpen() {
+        return open_;
+    }
+
+    int const fd;
+
+private:
+    static std::atomic_uint open_;
+};
+
 struct CrawlerJob {
     std::string path;
 
+    /** Open parent directory, relative to which the directory is opened by its name. If null, the directory is opened by its path.
+     */
+    std::shared_ptr<OpenDirectory> parent;
+
+    /** If true, the path is a projects file whose projects are read instead of crawling a directory.
+     */
+    bool projectsFile = false;
+
+    /** The directory is not checked here. Input directories are checked when given, and subdirectories are known to be directories from their entries.
+     */
     CrawlerJob(std::string const & path):
         path(path) {
-        if (not isDirectory(path))
-            throw STR("Input directory " << path << " not found");
+    }
+
+    CrawlerJob(std::string const & path, std::shared_ptr<OpenDirectory> const & parent):
+        path(path),
+        parent(parent) {
+    }
+
+    /** Name of the directory in its parent.
+     */
+    char const * name() const {
+        return path.c_str() + path.rfind('/') + 1;
+    }
+
+    /** Job reading the projects from given projects file, see PROJECTS_BINARY_MAGIC.
+     */
+    static CrawlerJob ProjectsFile(std::string const & filename) {
+        CrawlerJob result(filename);
+        result.projectsFile = true;
+        return result;
     }
 
     friend std::ostream & operator << (std::ostream & s, CrawlerJob const & job) {
@@ -17,19 +72,58 @@ struct CrawlerJob {
     }
 };
 
+/** Finds the git projects in the input directories.
+
+  Each directory is listed in large batches with getdents64 on Linux, and readdir elsewhere. Subdirectories are recognized by the type of their entries, and only stat'ed by file systems which do not report it. A directory whose listing contains .git is a project if it has the origin remote, otherwise its subdirectories are crawled as well, opened relative to the directory while not too many directories are kept open. Subdirectories go to the deque of the crawler, which crawls the newest of them first, depth first, while idle crawlers steal the oldest, i.e. the shallowest directories with whole subtrees below them.
+
+  Instead of crawling, the projects and their URLs can be listed in a projects file, which a single crawler streams to the readers, blocking whenever their queue is full, so that the file is never loaded as a whole.
+
+  Either way, only projects of the selected shard are tokenized, so that multiple nodes can split the projects between themselves without coordination.
+ */
 class Crawler : public QueueWorker<CrawlerJob> {
 public:
+    /** Maximum number of directories kept open for their subdirectories, above which subdirectories are opened by their full paths.
+     */
+    static constexpr unsigned MAX_OPEN_DIRECTORIES = 256;
+
+    /** Size of the buffer into which the directory entries are listed at once.
+     */
+    static constexpr size_t ENTRIES_BUFFER_SIZE = 64 * 1024;
+
     Crawler(unsigned index):
         QueueWorker<CrawlerJob>(STR("CRAWLER " << index)) {
     }
 
     static void initializeWorkers(unsigned num);
 
+    /** Selects the shard of the projects to tokenize, given as index/count. Projects are assigned to shards by the hash of their path.
+     */
+    static void SetShard(std::string const & spec);
+
 private:
     /** Checks whether a directory is git project, rercusively.
      */
     void process(CrawlerJob const & job) override;
 
+    /** Lists the directory, adding the names of its subdirectories to given vector. Returns true if the directory contains .git.
+     */
+    bool listDirectory(int fd, CrawlerJob const & job, std::vector<std::string> & subdirs);
+
     /** Returns the URL of git project in the given directory, or empty string if the directory is not git project. */
-    static std::string projectUrl(std::string const & path);
+    static std::string projectUrl(int fd);
+
+    /** Schedules the projects listed in given projects file, in either format.
+     */
+    void readProjectsFile(std::string const & filename);
+
+    /** Schedules the project for the readers if it belongs to the selected shard.
+     */
+    static void ScheduleProject(std::string const & path, std::string const & url);
+
+    static unsigned shard_;
+    static unsigned numShards_;
+
+    /** Buffer for the directory entries.
+     */
+    std::unique_ptr<char[]> entries_;
 };
@@ -1,8 +1,11 @@
 #include <fstream>
+#include <algorithm>
 
-#include "hashes/md5.h"
+#include "hashes/hash.h"
 
 #include "data.h"
+#include "binary.h"
+#include "manifest.h"
 
 
 
@@ -12,21 +15,17 @@
 std::vector<GitProject *> GitProject::projects_;
 
 void GitProject::parseFile(std::string const & filename) {
-    std::ifstream f(filename);
-    if (not f.good())
+    InputBuffer f;
+    if (not f.open(filename))
         throw STR("Unable to open prtoject info file " << filename);
-    while (not f.eof()) {
-        std::string tmp;
-        std::getline(f, tmp, '\n');
-        if (tmp == "")
-            break; // eof
+    forEachLine(f, [] (std::string const & tmp) {
         GitProject * pi = new GitProject();
         pi->loadFrom(tmp);
         size_t id = pi->id_ - PROJECT_ID_STARTS_AT;
         if (id >= projects_.size())
             projects_.resize(id + 1);
         projects_[id] = pi;
-    }
+    });
 }
 
 void GitProject::loadFrom(std::string const & tmp) {
@@ -37,13 +36,23 @@ void GitProject::loadFrom(std::string const & tmp) {
         id_ = std::stoi(items[0]);
 
         path_ = unescapePath(items[1]);
+        // the project is written with its github url already derived
         url_ = unescapePath(items[2]);
+        githubUrl_ = url_;
 
     } catch (...) {
         throw "Invalid format of statistics file";
     }
 }
 
+void GitProject::release() {
+    if (--handles_ != 0)
+        return;
+    if (head_ != GitOid())
+        Manifest::AddProject(path_, head_);
+    delete this;
+}
+
 
 
 
@@ -53,27 +62,23 @@ void GitProject::loadFrom(std::string const & tmp) {
 std::vector<FileStats *> FileStats::files_;
 
 void FileStats::parseFile(std::string const & filename) {
-    std::ifstream f(filename);
-    if (not f.good())
+    InputBuffer f;
+    if (not f.open(filename))
         throw STR("Unable to open file statistics " << filename);
-    while (not f.eof()) {
-        std::string tmp;
-        std::getline(f, tmp, '\n');
-        if (tmp == "")
-            break; // eof
+    forEachLine(f, [] (std::string const & tmp) {
         FileStats * fs = new FileStats();
         fs->loadFrom(tmp);
         size_t id = fs->id_ - FILE_ID_STARTS_AT;
         if (id >= files_.size())
             files_.resize(id + 1);
         files_[id] = fs;
-    }
+    });
 }
 
 void FileStats::loadFrom(std::string const & tmp) {
     std::vector<std::string> items(split(tmp, ','));
     try {
-        if (items.size() != 17)
+        if (items.size() != 19)
             throw STR("Invalid line format");
         id_ = std::stoi(items[0]);
         project_ = GitProject::Get(std::stoi(items[1]));
@@ -81,24 +86,26 @@ void FileStats::loadFrom(std::string const & tmp) {
             throw STR("File " << id_ << " contains invalid path for its project");
 
         relPath_ = unescapePath(items[3]);
+        // items[4] is the github url, which is derived from the project and relative path
+        createdDate = std::stoi(items[5]);
 
-        bytes_ = std::stoi(items[4]);
-        commentBytes_ = std::stoi(items[5]);
-        whitespaceBytes_ = std::stoi(items[6]);
-        tokenBytes_ = std::stoi(items[7]);
-        separatorBytes_ = std::stoi(items[8]);
+        bytes_ = std::stoi(items[6]);
+        commentBytes_ = std::stoi(items[7]);
+        whitespaceBytes_ = std::stoi(items[8]);
+        tokenBytes_ = std::stoi(items[9]);
+        separatorBytes_ = std::stoi(items[10]);
 
-        loc_ = std::stoi(items[9]);
-        commentLoc_ = std::stoi(items[10]);
-        emptyLoc_ = std::stoi(items[11]);
+        loc_ = std::stoi(items[11]);
+        commentLoc_ = std::stoi(items[12]);
+        emptyLoc_ = std::stoi(items[13]);
 
-        totalTokens = std::stoi(items[12]);
-        uniqueTokens_ = std::stoi(items[13]);
+        totalTokens = std::stoi(items[14]);
+        uniqueTokens_ = std::stoi(items[15]);
 
-        errors = std::stoi(items[14]);
+        errors = std::stoi(items[16]);
 
-        fileHash_ = items[15];
-        tokensHash_ = items[16];
+        if (not fileHash_.parse(items[17]) or not tokensHash_.parse(items[18]))
+            throw STR("Invalid hash in statistics of file " << id_);
     } catch (std::string const & e) {
         throw e;
     } catch (...) {
@@ -106,7 +113,7 @@ void FileStats::loadFrom(std::string const & tmp) {
     }
 }
 
-void FileStats::writeFullStats(std::ostream & s) {
+void FileStats::writeFullStats(OutputBuffer & s) {
     s << id_ << ","
       << project_->id_ << ","
       << escapePath(project_->path()) << ","
@@ -125,10 +132,10 @@ void FileStats::writeFullStats(std::ostream & s) {
       << uniqueTokens_ << ","
       << errors << ","
       << fileHash_ << ","
-      << tokensHash_ << std::endl;
+      << tokensHash_ << '\n';
 }
 
-void FileStats::writeSourcererStats(std::ostream & s) {
+void FileStats::writeSourcererStats(OutputBuffer & s) {
     s << project_->id_ << ","
       << id_ << ","
       << escapePath(absPath()) << ","
@@ -137,71 +144,216 @@ void FileStats::writeSourcererStats(std::ostream & s) {
       << bytes_ << ","
       << loc_ << ","
       << (loc_ - emptyLoc_) << ","
-      << (loc_ - emptyLoc_ - commentLoc_) << std::endl;
+      << (loc_ - emptyLoc_ - commentLoc_) << '\n';
+}
+
+void FileStats::writeTokens(TokenIds const & ids, OutputBuffer & s) {
+    s << project_->id_ << ","
+      << id_ << ","
+      << totalTokens << ","
+      << uniqueTokens_ << ","
+      << tokensHash_ << "@#@";
+    ids.writeSourcererFormat(s);
+    s << '\n';
+}
+
+void FileStats::writeBinaryStats(OutputBuffer & stats, OutputBuffer & paths) {
+    uint64_t pathOffset = paths.offset();
+    paths << relPath_;
+    stats.appendFixed32(id_)
+         .appendFixed32(project_->id_)
+         .appendFixed32(createdDate)
+         .appendFixed32(bytes_)
+         .appendFixed32(commentBytes_)
+         .appendFixed32(whitespaceBytes_)
+         .appendFixed32(tokenBytes_)
+         .appendFixed32(separatorBytes_)
+         .appendFixed32(loc_)
+         .appendFixed32(commentLoc_)
+         .appendFixed32(emptyLoc_)
+         .appendFixed32(totalTokens)
+         .appendFixed32(uniqueTokens_)
+         .appendFixed32(errors)
+         .appendFixed32(relPath_.size())
+         .appendFixed32(0) // padding
+         .appendFixed64(pathOffset)
+         .appendDigest(fileHash_)
+         .appendDigest(tokensHash_);
+}
+
+void FileStats::parseBinaryFile(std::string const & statsFile, std::string const & pathsFile) {
+    BinaryInput f(statsFile, FULL_STATS_BINARY_MAGIC);
+    BinaryInput paths(pathsFile, FULL_STATS_PATHS_BINARY_MAGIC);
+    while (not f.eof()) {
+        FileStats * fs = new FileStats();
+        fs->id_ = f.fixed32();
+        fs->project_ = GitProject::Get(f.fixed32());
+        fs->createdDate = f.fixed32();
+        fs->bytes_ = f.fixed32();
+        fs->commentBytes_ = f.fixed32();
+        fs->whitespaceBytes_ = f.fixed32();
+        fs->tokenBytes_ = f.fixed32();
+        fs->separatorBytes_ = f.fixed32();
+        fs->loc_ = f.fixed32();
+        fs->commentLoc_ = f.fixed32();
+        fs->emptyLoc_ = f.fixed32();
+        fs->totalTokens = f.fixed32();
+        fs->uniqueTokens_ = f.fixed32();
+        fs->errors = f.fixed32();
+        size_t pathSize = f.fixed32();
+        f.fixed32(); // padding
+        paths.skipTo(f.fixed64());
+        paths.bytes(pathSize, fs->relPath_);
+        fs->fileHash_ = f.digest();
+        fs->tokensHash_ = f.digest();
+        size_t id = fs->id_ - FILE_ID_STARTS_AT;
+        if (id >= files_.size())
+            files_.resize(id + 1);
+        files_[id] = fs;
+    }
 }
 
 // TokenMap --------------------------------------------------------------------
 
-std::string TokenMap::calculateHash() {
-    MD5 md5;
+unsigned & TokenMap::freq(TokenView const & token) {
+    if ((freqs_.size() + 1) * 2 > index_.size())
+        rehash();
+    size_t mask = index_.size() - 1;
+    size_t i = token.hash() & mask;
+    while (index_[i] != 0) {
+        std::pair<TokenView, unsigned> & x = freqs_[index_[i] - 1];
+        if (x.first == token)
+            return x.second;
+        i = (i + 1) & mask;
+    }
+    freqs_.push_back(std::pair<TokenView, unsigned>(token, 0));
+    index_[i] = freqs_.size();
+    sorted_ = false;
+    return freqs_.back().second;
+}
+
+void TokenMap::rehash() {
+    size_t capacity = 16;
+    while (capacity < (freqs_.size() + 1) * 4)
+        capacity *= 2;
+    index_.assign(capacity, 0);
+    size_t mask = capacity - 1;
+    for (size_t j = 0, e = freqs_.size(); j != e; ++j) {
+        size_t i = freqs_[j].first.hash() & mask;
+        while (index_[i] != 0)
+            i = (i + 1) & mask;
+        index_[i] = j + 1;
+    }
+}
+
+void TokenMap::sort() {
+    if (sorted_)
+        return;
+    std::sort(freqs_.begin(), freqs_.end(), [] (std::pair<TokenView, unsigned> const & a, std::pair<TokenView, unsigned> const & b) {
+        return a.first < b.first;
+    });
+    index_.clear();
+    sorted_ = true;
+}
+
+Digest TokenMap::calculateHash() {
+    sort();
+    Hasher h;
     for (auto i : freqs_) {
-        md5.add(i.first.c_str(), i.first.size());
-        md5.add(& i.second, sizeof(i.second));
+        h.add(i.first.data, i.first.size);
+        h.add(& i.second, sizeof(i.second));
     }
-    return md5.getHash();
+    return h.digest();
 }
 
-void TokenMap::writeSourcererFormat(std::ostream & s) {
-    if (not freqs_.empty()) {
-        auto i = freqs_.begin(), e = freqs_.end();
-        s << i->first << "@@::@@" << i->second;
-        ++i;
-        while (i != e) {
-            s << "," << i->first << "@@::@@" << i->second;
-            ++i;
-        }
+// TokenIds --------------------------------------------------------------------
+
+Digest TokenIds::calculateHash() {
+    Hasher h;
+    char buffer[8];
+    for (auto i : freqs_) {
+        h.add(buffer, OutputBuffer::FormatHex(i.first, buffer));
+        h.add(& i.second, sizeof(i.second));
+    }
+    return h.digest();
+}
+
+void TokenIds::writeSourcererFormat(OutputBuffer & s) const {
+    bool first = true;
+    for (auto i : freqs_) {
+        if (not first)
+            s << ',';
+        first = false;
+        s.appendHex(i.first);
+        s << "@@::@@" << i.second;
+    }
+}
+
+void TokenIds::writeBinary(OutputBuffer & s) const {
+    s.appendVarint(freqs_.size());
+    uint32_t last = 0;
+    for (auto i : freqs_) {
+        s.appendVarint(i.first - last);
+        s.appendVarint(i.second);
+        last = i.first;
     }
 }
 
 
 // TokenizedFile ---------------------------------------------------------------
 
-void TokenizedFile::updateFileStats(std::string const & contents) {
+void TokenizedFile::updateFileStats(FileBuffer const & contents) {
     stats.bytes_ = contents.size();
-    MD5 md5;
-    md5.add(contents.c_str(), contents.size());
-    stats.fileHash_ = md5.getHash();
+    Hasher h;
+    h.add(contents.data(), contents.size());
+    stats.fileHash_ = h.digest();
 }
 
-void TokenizedFile::writeTokens(std::ostream & s) {
-    s << stats.project_->id_ << ","
-      << stats.id_ << ","
-      << stats.totalTokens << ","
-      << stats.uniqueTokens_ << ","
-      << stats.tokensHash_ << "@#@";
-    tokens.writeSourcererFormat(s);
-    s << std::endl;
+void TokenizedFile::hashContents() {
+    Murmur3 h;
+    h.add(contents.data(), contents.size());
+    h.getHash(contentsHash.bytes);
+}
+
+TokenizedFile * TokenizedFile::summary() const {
+    TokenizedFile * result = new TokenizedFile();
+    result->stats = stats;
+    result->stats.project_ = nullptr;
+    result->stats.relPath_.clear();
+    result->stats.id_ = 0;
+    result->ids = ids;
+    result->contentsHash = contentsHash;
+    return result;
+}
+
+void TokenizedFile::reuse(TokenizedFile const & summary) {
+    FileStats s(summary.stats);
+    s.project_ = stats.project_;
+    s.relPath_ = std::move(stats.relPath_);
+    s.id_ = stats.id_;
+    s.createdDate = stats.createdDate;
+    stats = std::move(s);
+    ids = summary.ids;
+    contentsHash = summary.contentsHash;
+    reused = true;
 }
 
 
 
+
 // CloneInfo -------------------------------------------------------------------
 
 std::vector<CloneInfo *> CloneInfo::clones_;
 
 void CloneInfo::parseFile(std::string const & filename) {
-    std::ifstream f(filename);
-    if (not f.good())
+    InputBuffer f;
+    if (not f.open(filename))
         throw STR("Unable to open clone info " << filename);
-    while (not f.eof()) {
-        std::string tmp;
-        std::getline(f, tmp, '\n');
-        if (tmp == "")
-            break; // eof
+    forEachLine(f, [] (std::string const & tmp) {
         CloneInfo * ci = new CloneInfo();
         ci->loadFrom(tmp);
         clones_.push_back(ci);
-    }
+    });
 }
 
 void CloneInfo::loadFrom(std::string const & tmp) {
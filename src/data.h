@@ -1,14 +1,20 @@
 #pragma once
 #include <set>
+#include <cstring>
 #include <unordered_map>
 #include <map>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <atomic>
+#include <cstdint>
 
 #include "utils.h"
 #include "config.h"
+#include "hashes/hash.h"
+#include "input.h"
+#include "output.h"
+#include "git.h"
 
 
 constexpr unsigned FILE_ID_STARTS_AT = 1;
@@ -44,8 +50,8 @@ public:
         return id_;
     }
 
-    void writeTo(std::ostream & s) {
-        s << id_ << "," << escapePath(path()) << "," << escapePath(githubUrl()) << std::endl;
+    void writeTo(OutputBuffer & s) {
+        s << id_ << "," << escapePath(path()) << "," << escapePath(githubUrl()) << '\n';
     }
 
     GitProject():
@@ -64,11 +70,17 @@ public:
         return projects_.size();
     }
 
+    /** Releases a handle to the project.
+
+      The last handle deletes the project, which is then complete, i.e. each of its files was either written or skipped. If the project was read at a known HEAD, the HEAD is recorded in the manifest only at that point, so that the manifest never claims a project whose files were not written.
+     */
+    void release();
+
 private:
     friend class FileStats;
     friend class TokenizedFile;
-    friend class Tokenizer;
-    friend class TokenizerJob;
+    friend class Reader;
+    friend class ReaderJob;
 
     static std::string githubUrl(std::string const & giturl) {
         std::string url = giturl;
@@ -98,22 +110,75 @@ private:
 
     std::atomic_uint handles_;
 
+    /** HEAD at which the project was read, set when its files are known.
+     */
+    GitOid head_;
+
     static std::vector<GitProject *> projects_;
 
 };
 
 
+/** Token as a view into the buffer it was found in.
+
+  The tokenizers do not copy the tokens out of the file contents, but the contents must then live at least as long as any views into them.
+ */
+struct TokenView {
+    char const * data;
+    unsigned size;
+
+    TokenView(char const * data, unsigned size):
+        data(data),
+        size(size) {
+    }
+
+    std::string str() const {
+        return std::string(data, size);
+    }
+
+    /** FNV-1a hash of the token's contents.
+     */
+    size_t hash() const {
+        size_t result = 14695981039346656037ull;
+        for (unsigned i = 0; i < size; ++i) {
+            result ^= static_cast<unsigned char>(data[i]);
+            result *= 1099511628211ull;
+        }
+        return result;
+    }
+
+    bool operator == (TokenView const & other) const {
+        return size == other.size and memcmp(data, other.data, size) == 0;
+    }
+
+    /** Orders the views the same way std::string would order their contents.
+     */
+    bool operator < (TokenView const & other) const {
+        int c = memcmp(data, other.data, size < other.size ? size : other.size);
+        return c < 0 or (c == 0 and size < other.size);
+    }
+
+    friend std::ostream & operator << (std::ostream & s, TokenView const & token) {
+        s.write(token.data, token.size);
+        return s;
+    }
+};
+
 /** Token map.
 
-  Contains a map of tokens and their frequencies.
+  Contains tokens and their frequencies. The tokens are views into the contents of the tokenized file.
+
+  Tokens are kept in a vector in the order they were first seen, indexed by an open addressing hash table. The tokens are only sorted when the map is hashed, so that the hash does not depend on the order in which the tokens were added.
  */
 class TokenMap {
 public:
-    typedef std::map<std::string, unsigned>::const_iterator const_iterator;
-    typedef std::map<std::string, unsigned>::iterator iterator;
+    typedef std::vector<std::pair<TokenView, unsigned>>::const_iterator const_iterator;
+    typedef std::vector<std::pair<TokenView, unsigned>>::iterator iterator;
 
     void clear() {
         freqs_.clear();
+        index_.clear();
+        sorted_ = false;
     }
 
     const_iterator begin() const {
@@ -124,29 +189,85 @@ public:
         return freqs_.end();
     }
 
-    void add(std::string const & token) {
-        ++freqs_[token];
+    void add(TokenView const & token) {
+        ++freq(token);
+    }
+
+    void add(TokenView const & token, unsigned freq) {
+        this->freq(token) += freq;
     }
 
-    void add(std::string const & token, unsigned freq) {
-        freqs_[token] += freq;
+    unsigned size() const {
+        return freqs_.size();
     }
 
-    /** Outputs the tokens and their frequencies in the sourcererCC's format.
+private:
+    friend class TokenizedFile;
+
+    /** Returns the frequency of given token, adding the token with zero frequency if not present.
+     */
+    unsigned & freq(TokenView const & token);
+
+    /** Rebuilds the hash table so that it can hold at least one more token.
+     */
+    void rehash();
+
+    /** Sorts the tokens, invalidating the hash table.
      */
-    void writeSourcererFormat(std::ostream & s);
+    void sort();
+
+    Digest calculateHash();
+
+    std::vector<std::pair<TokenView, unsigned>> freqs_;
+
+    /** Open addressing hash table of indices to freqs_, offset by one so that 0 denotes empty slot.
+     */
+    std::vector<unsigned> index_;
+
+    bool sorted_ = false;
+};
+
+
+/** Global ids of a file's tokens and their frequencies.
+
+  When the merger interns the tokens of a file, they are replaced by their ids, sorted by the id. Ids are only formatted as hex numbers when hashed or written.
+ */
+class TokenIds {
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>>::const_iterator const_iterator;
+
+    void clear() {
+        freqs_.clear();
+    }
+
+    const_iterator begin() const {
+        return freqs_.begin();
+    }
+
+    const_iterator end() const {
+        return freqs_.end();
+    }
 
     unsigned size() const {
         return freqs_.size();
     }
 
+    /** Outputs the token ids and their frequencies in the sourcererCC's format.
+     */
+    void writeSourcererFormat(OutputBuffer & s) const;
+
+    /** Outputs the number of tokens followed by the delta encoded token ids and their frequencies as varints.
+     */
+    void writeBinary(OutputBuffer & s) const;
+
 private:
     friend class TokenizedFile;
+    friend class Merger;
+    friend class TokensReader;
 
+    Digest calculateHash();
 
-    std::string calculateHash();
-
-    std::map<std::string, unsigned> freqs_;
+    std::vector<std::pair<uint32_t, uint32_t>> freqs_;
 };
 
 
@@ -178,15 +299,19 @@ public:
         return project_->path() + "/" + relPath_;
     }
 
+    std::string const & relPath() const {
+        return relPath_;
+    }
+
     std::string githubUrl() const {
         return project_->githubUrl() + "/blob/master/" + relPath_;
     }
 
-    std::string const & fileHash() const {
+    Digest const & fileHash() const {
         return fileHash_;
     }
 
-    std::string const & tokensHash() const {
+    Digest const & tokensHash() const {
         return tokensHash_;
     }
 
@@ -194,13 +319,27 @@ public:
 
       File statistics are written in the format our analysis tools (including the tokenizer's analyzer and validator) expect it, and *not* in the sourcererCC's format.
      */
-    void writeFullStats(std::ostream & s);
+    void writeFullStats(OutputBuffer & s);
 
     /** Writes sourcererCC's statistics into given stream.
 
       These are used by the sourcererCC's tools and analyzer and validator ignore them. Only non-empty (token-wise) files should be are reported.
      */
-    void writeSourcererStats(std::ostream & s);
+    void writeSourcererStats(OutputBuffer & s);
+
+    /** Writes the file's tokens in sourcererCC's format, given the token ids of the file.
+     */
+    void writeTokens(TokenIds const & ids, OutputBuffer & s);
+
+    /** Writes the file statistics as a fixed width binary record, and the relative path of the file into the paths file the record points to.
+     */
+    void writeBinaryStats(OutputBuffer & stats, OutputBuffer & paths);
+
+    /** Loads file statistics from the binary stats file and its paths file.
+
+      The projects the files belong to must already be loaded.
+     */
+    static void parseBinaryFile(std::string const & statsFile, std::string const & pathsFile);
 
 
     unsigned id_ = 0;
@@ -239,8 +378,8 @@ private:
 
 
 
-    std::string fileHash_;
-    std::string tokensHash_;
+    Digest fileHash_;
+    Digest tokensHash_;
 
     static std::vector<FileStats *> files_;
 };
@@ -249,25 +388,30 @@ class TokenizedFile {
 public:
 
     bool empty() const {
-        return tokens.freqs_.empty();
+        return tokens.freqs_.empty() and ids.freqs_.empty();
     }
 
-    void updateFileStats(std::string const & contents);
+    void updateFileStats(FileBuffer const & contents);
+
+    /** Calculates the murmur3 hash of the contents as read into contentsHash, regardless of the selected hash algorithm.
+     */
+    void hashContents();
 
+    /** Calculates the hash of the file's tokens, or of their ids once the merger has interned them.
+     */
     void calculateTokensHash() {
-        stats.tokensHash_ = tokens.calculateHash();
+        if (ids.freqs_.empty())
+            stats.tokensHash_ = tokens.calculateHash();
+        else
+            stats.tokensHash_ = ids.calculateHash();
     }
 
-    void addToken(std::string const & token) {
+    void addToken(TokenView const & token) {
         ++stats.totalTokens;
-        stats.tokenBytes_ += token.size();
+        stats.tokenBytes_ += token.size;
         tokens.add(token);
     }
 
-    void updateTokenMap(TokenMap && map) {
-        tokens.freqs_ = std::move(map.freqs_);
-    }
-
     void addSeparator(size_t size) {
         stats.separatorBytes_ += size;
     }
@@ -321,7 +465,16 @@ public:
 
     /** Outputs the tokens in sourcererCC's format.
      */
-    void writeTokens(std::ostream & s);
+    void writeTokens(OutputBuffer & s) {
+        stats.writeTokens(ids, s);
+    }
+
+    /** Outputs the file id followed by the token ids in the binary format.
+     */
+    void writeBinaryTokens(OutputBuffer & s) {
+        s.appendVarint(stats.id_);
+        ids.writeBinary(s);
+    }
 
     TokenizedFile(GitProject * project, std::string const & relPath):
         stats(project, relPath) {
@@ -330,6 +483,14 @@ public:
 
     TokenizedFile() = default;
 
+    /** Creates a summary of the already interned file, i.e. its statistics and token ids without the project, path and ids, that files with identical contents can reuse.
+     */
+    TokenizedFile * summary() const;
+
+    /** Takes the statistics and token ids from the summary of a file with identical contents, keeping own project, path, ids and created date.
+     */
+    void reuse(TokenizedFile const & summary);
+
 
     /** Deletes the tokenized file.
 
@@ -337,12 +498,30 @@ public:
      */
     ~TokenizedFile() {
         if (stats.project_ != nullptr)
-            if (--stats.project_->handles_ == 0)
-                delete stats.project_;
+            stats.project_->release();
     }
 
     FileStats stats;
     TokenMap tokens;
+    TokenIds ids;
+
+    /** Contents of the file.
+
+      Tokens are views into the contents, which therefore must not change while the tokens are in use. Contents are released when the tokens are interned.
+     */
+    FileBuffer contents;
+
+    /** Id of the git blob the contents were read from, zero if they were read from the working tree.
+     */
+    GitOid blob;
+
+    /** Hash of the contents as read, before the tokenizer normalizes them.
+     */
+    Digest contentsHash;
+
+    /** True if the file reused the summary of an identical file and was never tokenized.
+     */
+    bool reused = false;
 };
 
 class CloneInfo {
@@ -366,8 +545,8 @@ public:
         return fid2_;
     }
 
-    void writeTo(std::ostream & s) {
-        s << pid1_ << "," << fid1_ << "," << pid2_ << "," << fid2_ << std::endl;
+    void writeTo(OutputBuffer & s) {
+        s << pid1_ << "," << fid1_ << "," << pid2_ << "," << fid2_ << '\n';
     }
 
     CloneInfo(unsigned pid1, unsigned fid1, unsigned pid2, unsigned fid2):
@@ -0,0 +1,37 @@
+#include "dictionary.h"
+
+TokenView TokenDictionary::Shard::store(TokenView const & token) {
+    char * result;
+    // tokens larger than a chunk get chunk of their own, the current chunk stays in use
+    if (token.size > CHUNK_SIZE) {
+        result = new char[token.size];
+        chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), result);
+    } else {
+        if (token.size > chunkFree or chunkFree == 0) {
+            chunks.push_back(new char[CHUNK_SIZE]);
+            chunkFree = CHUNK_SIZE;
+        }
+        result = chunks.back() + CHUNK_SIZE - chunkFree;
+        chunkFree -= token.size;
+    }
+    memcpy(result, token.data, token.size);
+    return TokenView(result, token.size);
+}
+
+unsigned TokenDictionary::idFor(TokenView const & token) {
+    Shard & s = shards_[token.hash() % NUM_SHARDS];
+    std::lock_guard<std::mutex> g(s.m);
+    auto i = s.ids.find(token);
+    if (i != s.ids.end())
+        return i->second;
+    unsigned id = size_++;
+    s.ids.emplace(s.store(token), id);
+    return id;
+}
+
+void TokenDictionary::insert(TokenView const & token, unsigned id) {
+    Shard & s = shards_[token.hash() % NUM_SHARDS];
+    s.ids.emplace(s.store(token), id);
+    if (id >= size_)
+        size_ = id + 1;
+}
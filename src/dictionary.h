@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "data.h"
+
+/** Concurrent dictionary of unique tokens.
+
+  Assigns each unique token a global id. The dictionary is split into shards by the token's hash, each guarded by its own mutex, so that threads interning different tokens do not serialize on a single lock. Ids are taken from a single atomic counter and are therefore dense.
+
+  Lookups take token views so that no string has to be constructed for tokens already present. When a token is added, its bytes are copied into the shard's own storage.
+ */
+class TokenDictionary {
+public:
+    static constexpr unsigned NUM_SHARDS = 64;
+
+    TokenDictionary():
+        size_(0) {
+    }
+
+    ~TokenDictionary() {
+        for (Shard & s : shards_)
+            for (char * chunk : s.chunks)
+                delete [] chunk;
+    }
+
+    /** Returns the id of the given token, assigning a new id if the token has not been seen yet.
+     */
+    unsigned idFor(TokenView const & token);
+
+    /** Adds the token with given id, such as a token loaded from previous output.
+
+      Must not run concurrently with idFor(). Ids of tokens added later continue after the largest id.
+     */
+    void insert(TokenView const & token, unsigned id);
+
+    /** Number of unique tokens in the dictionary.
+     */
+    unsigned size() const {
+        return size_;
+    }
+
+    /** Calls the given function with every token and its id.
+
+      Must not run concurrently with idFor().
+     */
+    template<typename FUNCTION>
+    void forEach(FUNCTION f) const {
+        for (Shard const & s : shards_)
+            for (auto const & i : s.ids)
+                f(i.first, i.second);
+    }
+
+private:
+    static constexpr unsigned CHUNK_SIZE = 65536;
+
+    struct Hash {
+        size_t operator () (TokenView const & token) const {
+            return token.hash();
+        }
+    };
+
+    struct Shard {
+        std::mutex m;
+        std::unordered_map<TokenView, unsigned, Hash> ids;
+        /** Storage for the tokens owned by the shard.
+         */
+        std::vector<char *> chunks;
+        unsigned chunkFree = 0;
+
+        /** Copies the token into the shard's storage.
+         */
+        TokenView store(TokenView const & token);
+    };
+
+    Shard shards_[NUM_SHARDS];
+
+    std::atomic_uint size_;
+};
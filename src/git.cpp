@@ -0,0 +1,591 @@
+#include <dirent.h>
+#include <algorithm>
+#include <queue>
+#include <tuple>
+#include <unordered_set>
+
+#include <zlib.h>
+
+#include "utils.h"
+
+#include "git.h"
+
+namespace {
+
+    /** Inflates zlib compressed data into given string.
+
+      If the size of the result is known, it is passed as the expected size and only that much is inflated, otherwise the whole stream is.
+     */
+    void inflateInto(char const * data, size_t size, std::string & into, size_t expected = std::string::npos) {
+        z_stream zs = z_stream();
+        if (inflateInit(& zs) != Z_OK)
+            throw std::string("Unable to initialize decompression of git object");
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in = size;
+        into.resize(expected == std::string::npos ? size * 4 + 64 : expected);
+        size_t done = 0;
+        while (true) {
+            if (done == into.size()) {
+                if (expected != std::string::npos)
+                    break;
+                into.resize(into.size() * 2);
+            }
+            zs.next_out = reinterpret_cast<Bytef *>(& into[done]);
+            zs.avail_out = into.size() - done;
+            int status = inflate(& zs, Z_NO_FLUSH);
+            done = into.size() - zs.avail_out;
+            if (status == Z_STREAM_END)
+                break;
+            if (status != Z_OK) {
+                inflateEnd(& zs);
+                throw std::string("Corrupted git object");
+            }
+        }
+        inflateEnd(& zs);
+        if (expected != std::string::npos and done != expected)
+            throw std::string("Corrupted git object");
+        into.resize(done);
+    }
+
+    /** Reads a variable length size of the delta format.
+     */
+    size_t deltaSize(char const * & p, char const * end) {
+        size_t result = 0;
+        unsigned shift = 0;
+        while (p < end) {
+            uint8_t b = *p++;
+            result |= static_cast<size_t>(b & 0x7f) << shift;
+            shift += 7;
+            if ((b & 0x80) == 0)
+                return result;
+        }
+        throw std::string("Corrupted git delta");
+    }
+
+    /** Applies the git delta to given base.
+     */
+    void applyDelta(std::string const & base, std::string const & delta, std::string & into) {
+        char const * p = delta.data();
+        char const * end = p + delta.size();
+        if (deltaSize(p, end) != base.size())
+            throw std::string("Git delta does not match its base");
+        into.resize(deltaSize(p, end));
+        size_t done = 0;
+        while (p < end) {
+            uint8_t op = *p++;
+            if (op & 0x80) {
+                // copy from base, offset and size bytes are present as given by the flags
+                size_t offset = 0;
+                size_t size = 0;
+                for (unsigned i = 0; i < 4; ++i)
+                    if (op & (1 << i))
+                        offset |= static_cast<size_t>(static_cast<uint8_t>(*p++)) << (i * 8);
+                for (unsigned i = 0; i < 3; ++i)
+                    if (op & (0x10 << i))
+                        size |= static_cast<size_t>(static_cast<uint8_t>(*p++)) << (i * 8);
+                if (size == 0)
+                    size = 0x10000;
+                if (offset + size > base.size() or done + size > into.size())
+                    throw std::string("Corrupted git delta");
+                memcpy(& into[done], base.data() + offset, size);
+                done += size;
+            } else if (op != 0) {
+                // insert literal bytes
+                if (p + op > end or done + op > into.size())
+                    throw std::string("Corrupted git delta");
+                memcpy(& into[done], p, op);
+                p += op;
+                done += op;
+            } else {
+                throw std::string("Corrupted git delta");
+            }
+        }
+        if (done != into.size())
+            throw std::string("Corrupted git delta");
+    }
+
+    uint32_t bigEndian32(char const * p) {
+        uint8_t const * b = reinterpret_cast<uint8_t const *>(p);
+        return (static_cast<uint32_t>(b[0]) << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+    }
+
+    std::string readFirstLine(std::string const & filename) {
+        FileBuffer f;
+        if (not f.load(filename))
+            return "";
+        std::string result(f.data(), f.size());
+        size_t eol = result.find('\n');
+        if (eol != std::string::npos)
+            result.resize(eol);
+        return result;
+    }
+
+    /** Compares tree entry names in git's tree order, where trees sort as if their names ended with a slash.
+     */
+    int compareEntries(GitRepository::TreeEntry const & a, GitRepository::TreeEntry const & b) {
+        size_t n = std::min(a.name.size(), b.name.size());
+        int c = memcmp(a.name.data(), b.name.data(), n);
+        if (c != 0)
+            return c;
+        unsigned char ca = a.name.size() > n ? a.name[n] : (a.isTree() ? '/' : 0);
+        unsigned char cb = b.name.size() > n ? b.name[n] : (b.isTree() ? '/' : 0);
+        return static_cast<int>(ca) - static_cast<int>(cb);
+    }
+
+}
+
+// GitOid ----------------------------------------------------------------------
+
+std::string GitOid::hex() const {
+    std::string result;
+    result.reserve(Bytes * 2);
+    for (uint8_t b : bytes) {
+        result += toHexDigit(b >> 4);
+        result += toHexDigit(b & 0xf);
+    }
+    return result;
+}
+
+bool GitOid::parse(char const * hex) {
+    for (unsigned i = 0; i < Bytes * 2; ++i) {
+        char c = hex[i];
+        if (not ((c >= '0' and c <= '9') or (c >= 'a' and c <= 'f')))
+            return false;
+    }
+    for (unsigned i = 0; i < Bytes; ++i)
+        bytes[i] = fromHexDigit(hex[i * 2]) * 16 + fromHexDigit(hex[i * 2 + 1]);
+    return true;
+}
+
+// GitRepository::Pack ---------------------------------------------------------
+
+/** Packfile and its index.
+
+  Base objects of deltas are cached, as consecutive versions of the same tree or file are usually deltified against each other.
+ */
+class GitRepository::Pack {
+public:
+    Pack(GitRepository & repo, std::string const & index):
+        repo_(repo),
+        cacheSize_(0) {
+        if (not index_.load(index) or index_.size() < 8 + 256 * 4)
+            throw STR("Unable to read git pack index " << index);
+        if (bigEndian32(index_.data()) != 0xff744f63 or bigEndian32(index_.data() + 4) != 2)
+            throw STR("Unsupported git pack index version " << index);
+        numObjects_ = bigEndian32(index_.data() + 8 + 255 * 4);
+        std::string pack = index.substr(0, index.size() - 4) + ".pack";
+        if (not pack_.load(pack) or pack_.size() < 12)
+            throw STR("Unable to read git pack " << pack);
+    }
+
+    /** Returns the offset of the object in the pack, or 0 if the pack does not contain the object.
+     */
+    uint64_t find(GitOid const & id) const {
+        char const * fanout = index_.data() + 8;
+        uint32_t lo = id.bytes[0] == 0 ? 0 : bigEndian32(fanout + (id.bytes[0] - 1) * 4);
+        uint32_t hi = bigEndian32(fanout + id.bytes[0] * 4);
+        char const * ids = fanout + 256 * 4;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            int c = memcmp(ids + mid * GitOid::Bytes, id.bytes, GitOid::Bytes);
+            if (c == 0)
+                return offset(mid);
+            if (c < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return 0;
+    }
+
+    Type read(uint64_t offset, std::string & into) {
+        auto i = cache_.find(offset);
+        if (i != cache_.end()) {
+            into = i->second.second;
+            return i->second.first;
+        }
+        if (offset >= pack_.size())
+            throw std::string("Invalid offset in git pack");
+        char const * p = pack_.data() + offset;
+        char const * end = pack_.data() + pack_.size();
+        uint8_t b = *p++;
+        unsigned type = (b >> 4) & 7;
+        size_t size = b & 0x0f;
+        unsigned shift = 4;
+        while (b & 0x80) {
+            if (p == end)
+                throw std::string("Corrupted git pack");
+            b = *p++;
+            size |= static_cast<size_t>(b & 0x7f) << shift;
+            shift += 7;
+        }
+        if (type >= 1 and type <= 4) {
+            inflateInto(p, end - p, into, size);
+            return static_cast<Type>(type);
+        }
+        std::string base;
+        Type result;
+        if (type == 6) {
+            // offset delta, the base is at a negative offset encoded in a slightly different varint
+            if (p == end)
+                throw std::string("Corrupted git pack");
+            b = *p++;
+            uint64_t negative = b & 0x7f;
+            while (b & 0x80) {
+                if (p == end)
+                    throw std::string("Corrupted git pack");
+                b = *p++;
+                negative = ((negative + 1) << 7) | (b & 0x7f);
+            }
+            if (negative > offset)
+                throw std::string("Corrupted git pack");
+            result = read(offset - negative, base);
+            remember(offset - negative, result, base);
+        } else if (type == 7) {
+            // reference delta, the base may be anywhere in the repository
+            if (end - p < GitOid::Bytes)
+                throw std::string("Corrupted git pack");
+            GitOid baseId;
+            memcpy(baseId.bytes, p, GitOid::Bytes);
+            p += GitOid::Bytes;
+            result = repo_.read(baseId, base);
+        } else {
+            throw STR("Unknown git pack object type " << type);
+        }
+        std::string delta;
+        inflateInto(p, end - p, delta, size);
+        applyDelta(base, delta, into);
+        return result;
+    }
+
+private:
+    static constexpr size_t MAX_CACHE_SIZE = 32 * 1024 * 1024;
+
+    uint64_t offset(uint32_t index) const {
+        char const * offsets = index_.data() + 8 + 256 * 4 + numObjects_ * (GitOid::Bytes + 4);
+        uint32_t result = bigEndian32(offsets + index * 4);
+        // offsets of packs larger than 2GB are in a separate table of 8 byte offsets
+        if (result & 0x80000000) {
+            char const * large = offsets + numObjects_ * 4 + (result & 0x7fffffff) * 8;
+            return (static_cast<uint64_t>(bigEndian32(large)) << 32) | bigEndian32(large + 4);
+        }
+        return result;
+    }
+
+    void remember(uint64_t offset, Type type, std::string const & object) {
+        if (cacheSize_ + object.size() > MAX_CACHE_SIZE) {
+            cache_.clear();
+            cacheSize_ = 0;
+        }
+        if (object.size() > MAX_CACHE_SIZE / 4)
+            return;
+        cache_[offset] = std::make_pair(type, object);
+        cacheSize_ += object.size();
+    }
+
+    GitRepository & repo_;
+    FileBuffer index_;
+    FileBuffer pack_;
+    uint32_t numObjects_;
+
+    std::unordered_map<uint64_t, std::pair<Type, std::string>> cache_;
+    size_t cacheSize_;
+};
+
+// GitRepository ---------------------------------------------------------------
+
+GitRepository::GitRepository(std::string const & path) {
+    if (isDirectory(path + "/.git")) {
+        gitDir_ = path + "/.git";
+    } else if (isFile(path + "/.git")) {
+        // worktrees and submodules point to their git directory
+        std::string link = readFirstLine(path + "/.git");
+        if (link.find("gitdir: ") != 0)
+            throw STR("Invalid .git file in " << path);
+        gitDir_ = link.substr(8);
+        if (gitDir_[0] != '/')
+            gitDir_ = path + "/" + gitDir_;
+    } else if (isFile(path + "/HEAD") and isDirectory(path + "/objects")) {
+        gitDir_ = path;
+    } else {
+        throw STR("Not a git repository: " << path);
+    }
+    std::string common = readFirstLine(gitDir_ + "/commondir");
+    if (not common.empty())
+        common = common[0] == '/' ? common : gitDir_ + "/" + common;
+    else
+        common = gitDir_;
+    addObjectStore(common + "/objects");
+    loadShallow(common + "/shallow");
+}
+
+GitRepository::~GitRepository() {
+}
+
+void GitRepository::addObjectStore(std::string const & objects, unsigned depth) {
+    if (depth > 5 or std::find(objects_.begin(), objects_.end(), objects) != objects_.end())
+        return;
+    objects_.push_back(objects);
+    if (DIR * d = opendir((objects + "/pack").c_str())) {
+        std::vector<std::string> indices;
+        while (struct dirent * e = readdir(d)) {
+            std::string name = e->d_name;
+            if (endsWith(name, ".idx"))
+                indices.push_back(objects + "/pack/" + name);
+        }
+        closedir(d);
+        std::sort(indices.begin(), indices.end());
+        for (std::string const & index : indices)
+            packs_.push_back(std::unique_ptr<Pack>(new Pack(*this, index)));
+    }
+    // forks may borrow objects from other repositories
+    FileBuffer alternates;
+    if (alternates.load(objects + "/info/alternates"))
+        for (std::string const & line : split(std::string(alternates.data(), alternates.size()), '\n'))
+            if (not line.empty() and line[0] != '#')
+                addObjectStore(line[0] == '/' ? line : objects + "/" + line, depth + 1);
+}
+
+GitOid GitRepository::head() {
+    GitOid result;
+    std::string head = readFirstLine(gitDir_ + "/HEAD");
+    if (head.find("ref: ") == 0) {
+        if (not resolveRef(head.substr(5), result))
+            throw STR("Unable to resolve HEAD of " << gitDir_);
+    } else if (head.size() < GitOid::Bytes * 2 or not result.parse(head.c_str())) {
+        throw STR("Invalid HEAD in " << gitDir_);
+    }
+    return result;
+}
+
+bool GitRepository::resolveRef(std::string const & ref, GitOid & into, unsigned depth) {
+    if (depth > 5)
+        return false;
+    std::string value = readFirstLine(gitDir_ + "/" + ref);
+    std::string common = readFirstLine(gitDir_ + "/commondir");
+    if (value.empty() and not common.empty())
+        value = readFirstLine((common[0] == '/' ? common : gitDir_ + "/" + common) + "/" + ref);
+    if (value.find("ref: ") == 0)
+        return resolveRef(value.substr(5), into, depth + 1);
+    if (value.size() >= GitOid::Bytes * 2)
+        return into.parse(value.c_str());
+    // the ref may be packed
+    FileBuffer packed;
+    if (not packed.load(gitDir_ + "/packed-refs") and (common.empty() or not packed.load((common[0] == '/' ? common : gitDir_ + "/" + common) + "/packed-refs")))
+        return false;
+    for (std::string const & line : split(std::string(packed.data(), packed.size()), '\n'))
+        if (line.size() == GitOid::Bytes * 2 + 1 + ref.size() and line.compare(GitOid::Bytes * 2 + 1, std::string::npos, ref) == 0)
+            return into.parse(line.c_str());
+    return false;
+}
+
+GitRepository::Type GitRepository::read(GitOid const & id, std::string & into) {
+    for (auto & pack : packs_) {
+        uint64_t offset = pack->find(id);
+        if (offset != 0)
+            return pack->read(offset, into);
+    }
+    Type result;
+    for (std::string const & objects : objects_)
+        if (readLoose(objects, id, result, into))
+            return result;
+    throw STR("Git object " << id.hex() << " not found in " << gitDir_);
+}
+
+void GitRepository::read(GitOid const & id, Type expected, std::string & into) {
+    if (read(id, into) != expected)
+        throw STR("Git object " << id.hex() << " is not of expected type");
+}
+
+bool GitRepository::readLoose(std::string const & objects, GitOid const & id, Type & type, std::string & into) {
+    std::string hex = id.hex();
+    FileBuffer f;
+    if (not f.load(objects + "/" + hex.substr(0, 2) + "/" + hex.substr(2)))
+        return false;
+    std::string raw;
+    inflateInto(f.data(), f.size(), raw);
+    // header is the type, space, size and a zero byte
+    size_t space = raw.find(' ');
+    size_t zero = raw.find('\0');
+    if (space == std::string::npos or zero == std::string::npos or space > zero)
+        throw STR("Corrupted git object " << hex);
+    std::string t = raw.substr(0, space);
+    if (t == "commit")
+        type = Type::commit;
+    else if (t == "tree")
+        type = Type::tree;
+    else if (t == "blob")
+        type = Type::blob;
+    else if (t == "tag")
+        type = Type::tag;
+    else
+        throw STR("Unknown type of git object " << hex);
+    into = raw.substr(zero + 1);
+    return true;
+}
+
+void GitRepository::parseTree(std::string const & tree, std::vector<TreeEntry> & into) {
+    into.clear();
+    size_t i = 0;
+    while (i < tree.size()) {
+        size_t space = tree.find(' ', i);
+        size_t zero = tree.find('\0', space);
+        if (space == std::string::npos or zero == std::string::npos or zero + 1 + GitOid::Bytes > tree.size())
+            throw std::string("Corrupted git tree");
+        TreeEntry e;
+        e.mode = 0;
+        for (size_t j = i; j < space; ++j)
+            e.mode = e.mode * 8 + (tree[j] - '0');
+        e.name = tree.substr(space + 1, zero - space - 1);
+        memcpy(e.id.bytes, tree.data() + zero + 1, GitOid::Bytes);
+        into.push_back(e);
+        i = zero + 1 + GitOid::Bytes;
+    }
+}
+
+void GitRepository::loadShallow(std::string const & filename) {
+    FileBuffer f;
+    if (not f.load(filename))
+        return;
+    // one hex id per line
+    for (size_t i = 0; i + GitOid::Bytes * 2 <= f.size(); i += GitOid::Bytes * 2 + 1) {
+        GitOid id;
+        if (id.parse(f.data() + i))
+            shallow_.push_back(id);
+    }
+    std::sort(shallow_.begin(), shallow_.end());
+}
+
+void GitRepository::parseCommit(GitOid const & id, Commit & into) {
+    std::string commit;
+    read(id, Type::commit, commit);
+    size_t i = 0;
+    while (i < commit.size()) {
+        size_t eol = commit.find('\n', i);
+        if (eol == std::string::npos)
+            eol = commit.size();
+        // headers end with an empty line, the message follows
+        if (eol == i)
+            break;
+        if (commit.compare(i, 5, "tree ") == 0) {
+            into.tree.parse(commit.c_str() + i + 5);
+        } else if (commit.compare(i, 7, "parent ") == 0) {
+            GitOid parent;
+            parent.parse(commit.c_str() + i + 7);
+            into.parents.push_back(parent);
+        } else if (commit.compare(i, 7, "author ") == 0 or commit.compare(i, 10, "committer ") == 0) {
+            // the time follows the email and precedes the timezone
+            size_t email = commit.rfind('>', eol);
+            unsigned time = email != std::string::npos and email > i ? std::strtoul(commit.c_str() + email + 1, nullptr, 10) : 0;
+            if (commit[i] == 'a')
+                into.authorTime = time;
+            else
+                into.commitTime = time;
+        }
+        i = eol + 1;
+    }
+    // parents of shallow commits were not fetched, so shallow commits are roots just like git log shows them
+    if (std::binary_search(shallow_.begin(), shallow_.end(), id))
+        into.parents.clear();
+}
+
+GitOid GitRepository::commitTree(GitOid const & commit) {
+    Commit c;
+    parseCommit(commit, c);
+    return c.tree;
+}
+
+void GitRepository::forEachFile(GitOid const & tree, std::function<void(std::string const &, TreeEntry const &)> f) {
+    forEachFile(tree, "", f);
+}
+
+void GitRepository::forEachFile(GitOid const & tree, std::string const & prefix, std::function<void(std::string const &, TreeEntry const &)> const & f) {
+    std::string contents;
+    std::vector<TreeEntry> entries;
+    read(tree, Type::tree, contents);
+    parseTree(contents, entries);
+    for (TreeEntry const & e : entries)
+        if (e.isTree())
+            forEachFile(e.id, prefix + e.name + "/", f);
+        else
+            f(prefix + e.name, e);
+}
+
+void GitRepository::addedFiles(GitOid const & oldTree, GitOid const & newTree, std::string const & prefix, std::function<void(std::string const &)> const & f) {
+    std::vector<TreeEntry> older;
+    std::vector<TreeEntry> newer;
+    std::string contents;
+    if (oldTree != GitOid()) {
+        read(oldTree, Type::tree, contents);
+        parseTree(contents, older);
+    }
+    if (newTree != GitOid()) {
+        read(newTree, Type::tree, contents);
+        parseTree(contents, newer);
+    }
+    size_t o = 0;
+    for (TreeEntry const & n : newer) {
+        while (o < older.size() and compareEntries(older[o], n) < 0)
+            ++o;
+        bool existed = o < older.size() and older[o].name == n.name;
+        if (existed and older[o].id == n.id and older[o].isTree() == n.isTree())
+            continue;
+        if (n.isTree())
+            addedFiles(existed and older[o].isTree() ? older[o].id : GitOid(), n.id, prefix + n.name + "/", f);
+        else if (not existed or older[o].isTree())
+            f(prefix + n.name);
+    }
+}
+
+void GitRepository::forEachAddedFile(std::function<void(unsigned, std::string const &)> f) {
+    // newest commits first, commits with equal time in the order they were found
+    typedef std::tuple<unsigned, int64_t, GitOid> Item;
+    auto newer = [] (Item const & a, Item const & b) {
+        if (std::get<0>(a) != std::get<0>(b))
+            return std::get<0>(a) < std::get<0>(b);
+        return std::get<1>(a) > std::get<1>(b);
+    };
+    std::priority_queue<Item, std::vector<Item>, decltype(newer)> queue(newer);
+    std::unordered_set<GitOid> seen;
+    std::unordered_map<GitOid, Commit> commits;
+    int64_t order = 0;
+    GitOid start = head();
+    Commit c;
+    parseCommit(start, c);
+    commits[start] = c;
+    seen.insert(start);
+    queue.push(Item(c.commitTime, order++, start));
+    while (not queue.empty()) {
+        GitOid id = std::get<2>(queue.top());
+        queue.pop();
+        Commit commit = std::move(commits[id]);
+        commits.erase(id);
+        for (GitOid const & parent : commit.parents) {
+            if (not seen.insert(parent).second)
+                continue;
+            Commit p;
+            parseCommit(parent, p);
+            queue.push(Item(p.commitTime, order++, parent));
+            commits[parent] = std::move(p);
+        }
+        // merges are not diffed, root commits add everything
+        if (commit.parents.size() > 1)
+            continue;
+        GitOid parentTree;
+        if (not commit.parents.empty()) {
+            // the parent is usually still queued, unless commit times are skewed
+            auto i = commits.find(commit.parents[0]);
+            if (i != commits.end()) {
+                parentTree = i->second.tree;
+            } else {
+                Commit p;
+                parseCommit(commit.parents[0], p);
+                parentTree = p.tree;
+            }
+        }
+        unsigned time = commit.authorTime;
+        addedFiles(parentTree, commit.tree, "", [time, & f] (std::string const & path) {
+            f(time, path);
+        });
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+
+/** SHA-1 id of a git object.
+ */
+struct GitOid {
+    enum { Bytes = 20 };
+
+    uint8_t bytes[Bytes];
+
+    GitOid() {
+        memset(bytes, 0, Bytes);
+    }
+
+    bool operator == (GitOid const & other) const {
+        return memcmp(bytes, other.bytes, Bytes) == 0;
+    }
+
+    bool operator != (GitOid const & other) const {
+        return not (*this == other);
+    }
+
+    bool operator < (GitOid const & other) const {
+        return memcmp(bytes, other.bytes, Bytes) < 0;
+    }
+
+    size_t hash() const {
+        size_t result;
+        memcpy(& result, bytes, sizeof(result));
+        return result;
+    }
+
+    std::string hex() const;
+
+    /** Parses the id from its 40 hex characters. Returns false if the string does not start with a valid id.
+     */
+    bool parse(char const * hex);
+};
+
+namespace std {
+    template<>
+    struct hash<GitOid> {
+        size_t operator()(GitOid const & id) const {
+            return id.hash();
+        }
+    };
+}
+
+/** Read only access to the object store of a git repository.
+
+  Loose objects and packfiles (index version 2, including offset and reference deltas) are read directly, without libgit2 or spawning git. Alternate object stores are followed, so that forks sharing objects work as well.
+
+  Errors, such as missing or corrupted objects, are thrown.
+ */
+class GitRepository {
+public:
+    enum class Type {
+        none = 0,
+        commit = 1,
+        tree = 2,
+        blob = 3,
+        tag = 4,
+    };
+
+    /** Entry of a tree object.
+     */
+    struct TreeEntry {
+        unsigned mode;
+        std::string name;
+        GitOid id;
+
+        bool isTree() const {
+            return mode == 040000;
+        }
+
+        /** True for regular files, false for trees, symlinks and submodules.
+         */
+        bool isFile() const {
+            return (mode & 0170000) == 0100000;
+        }
+    };
+
+    /** Opens the repository of the working tree, or the bare repository, at given path.
+
+      Throws if there is no repository.
+     */
+    GitRepository(std::string const & path);
+
+    ~GitRepository();
+
+    /** Returns the id of the commit HEAD points to.
+     */
+    GitOid head();
+
+    /** Returns the id of the tree of given commit.
+     */
+    GitOid commitTree(GitOid const & commit);
+
+    /** Reads the object into given string and returns its type. Throws if the object does not exist.
+     */
+    Type read(GitOid const & id, std::string & into);
+
+    /** Reads the object and checks that it is of expected type.
+     */
+    void read(GitOid const & id, Type expected, std::string & into);
+
+    /** Parses the tree object into its entries.
+     */
+    static void parseTree(std::string const & tree, std::vector<TreeEntry> & into);
+
+    /** Calls the function with the path and entry of everything but trees reachable from given tree, i.e. of files, symlinks and submodules.
+     */
+    void forEachFile(GitOid const & tree, std::function<void(std::string const &, TreeEntry const &)> f);
+
+    /** Calls the function with the author time and path of every file added by the commits reachable from HEAD.
+
+      Equivalent to git log --no-renames --diff-filter=A --name-only --format=%at, including the order of the commits, which are walked newest first by their commit time. Merge commits add no files, root commits add all their files.
+     */
+    void forEachAddedFile(std::function<void(unsigned, std::string const &)> f);
+
+    /** Returns the sorted ids of the shallow commits of a shallow clone, whose parents are not in the repository, or nothing if the repository is complete.
+     */
+    std::vector<GitOid> const & shallow() const {
+        return shallow_;
+    }
+
+private:
+    class Pack;
+
+    struct Commit {
+        GitOid tree;
+        std::vector<GitOid> parents;
+        unsigned authorTime = 0;
+        unsigned commitTime = 0;
+    };
+
+    void parseCommit(GitOid const & id, Commit & into);
+
+    void forEachFile(GitOid const & tree, std::string const & prefix, std::function<void(std::string const &, TreeEntry const &)> const & f);
+
+    /** Calls the function for each file in the new tree which is not in the old tree. Either tree may be the zero id for an empty tree.
+     */
+    void addedFiles(GitOid const & oldTree, GitOid const & newTree, std::string const & prefix, std::function<void(std::string const &)> const & f);
+
+    bool readLoose(std::string const & objects, GitOid const & id, Type & type, std::string & into);
+
+    /** Resolves given ref, such as refs/heads/master, to the object id.
+     */
+    bool resolveRef(std::string const & ref, GitOid & into, unsigned depth = 0);
+
+    void addObjectStore(std::string const & objects, unsigned depth = 0);
+
+    /** Loads the shallow commits from given shallow file, if it exists.
+     */
+    void loadShallow(std::string const & filename);
+
+    std::string gitDir_;
+
+    /** Shallow commits, which are treated as root commits since their parents are missing.
+     */
+    std::vector<GitOid> shallow_;
+
+    /** Object directories, the repository's own first, followed by its alternates.
+     */
+    std::vector<std::string> objects_;
+
+    std::vector<std::unique_ptr<Pack>> packs_;
+};
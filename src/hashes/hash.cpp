@@ -0,0 +1,47 @@
+#include "hash.h"
+
+#include "../utils.h"
+
+namespace {
+
+    bool isLowerHexDigit(char c) {
+        return (c >= '0' and c <= '9') or (c >= 'a' and c <= 'f');
+    }
+
+}
+
+Hasher::Kind Hasher::algorithm_ = Hasher::Kind::murmur3;
+
+Hasher::Kind Hasher::Parse(std::string const & name) {
+    if (name == "md5")
+        return Kind::md5;
+    if (name == "murmur3")
+        return Kind::murmur3;
+    throw STR("Unknown hash algorithm " << name);
+}
+
+std::string Digest::hex() const {
+    std::string result(Bytes * 2, '0');
+    writeHex(& result[0]);
+    return result;
+}
+
+bool Digest::parse(std::string const & hex) {
+    if (hex.size() != Bytes * 2)
+        return false;
+    for (size_t i = 0; i < Bytes; ++i) {
+        char h = hex[i * 2];
+        char l = hex[i * 2 + 1];
+        if (not isLowerHexDigit(h) or not isLowerHexDigit(l))
+            return false;
+        bytes[i] = (fromHexDigit(h) << 4) + fromHexDigit(l);
+    }
+    return true;
+}
+
+void Digest::writeHex(char * into) const {
+    for (size_t i = 0; i < Bytes; ++i) {
+        *into++ = toHexDigit(bytes[i] >> 4);
+        *into++ = toHexDigit(bytes[i] & 0xf);
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "md5.h"
+#include "murmur3.h"
+
+/** Binary 128bit digest of file contents or tokens.
+
+  Digests are kept in binary form and only converted to 32 lowercase hex characters when written, which for MD5 gives exactly the usual hex form of the hash.
+ */
+struct Digest {
+    enum { Bytes = 16 };
+
+    uint8_t bytes[Bytes];
+
+    Digest() {
+        memset(bytes, 0, Bytes);
+    }
+
+    bool operator == (Digest const & other) const {
+        return memcmp(bytes, other.bytes, Bytes) == 0;
+    }
+
+    bool operator != (Digest const & other) const {
+        return not (*this == other);
+    }
+
+    bool operator < (Digest const & other) const {
+        return memcmp(bytes, other.bytes, Bytes) < 0;
+    }
+
+    /** The digest bytes are already well mixed, so any of them make a good hash.
+     */
+    size_t hash() const {
+        size_t result;
+        memcpy(& result, bytes, sizeof(result));
+        return result;
+    }
+
+    std::string hex() const;
+
+    /** Parses digest from its hex form. Returns false if the string is not a valid digest.
+     */
+    bool parse(std::string const & hex);
+
+    /** Writes the 32 hex characters of the digest into given buffer.
+     */
+    void writeHex(char * into) const;
+
+    friend std::ostream & operator << (std::ostream & s, Digest const & d) {
+        char buffer[Bytes * 2];
+        d.writeHex(buffer);
+        s.write(buffer, Bytes * 2);
+        return s;
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<Digest> {
+        size_t operator()(Digest const & d) const {
+            return d.hash();
+        }
+    };
+}
+
+/** Calculates digests with the algorithm selected by Hasher::Algorithm().
+
+  The default murmur3 is much faster, md5 produces the hashes sourcererCC and previous versions of the tokenizer output. The algorithm must not change while files are being processed.
+ */
+class Hasher {
+public:
+    enum class Kind {
+        md5,
+        murmur3,
+    };
+
+    Hasher():
+        kind_(algorithm_) {
+    }
+
+    void add(void const * data, size_t numBytes) {
+        if (kind_ == Kind::murmur3)
+            murmur3_.add(data, numBytes);
+        else
+            md5_.add(data, numBytes);
+    }
+
+    Digest digest() {
+        Digest result;
+        if (kind_ == Kind::murmur3)
+            murmur3_.getHash(result.bytes);
+        else
+            md5_.getHash(result.bytes);
+        return result;
+    }
+
+    static Kind & Algorithm() {
+        return algorithm_;
+    }
+
+    /** Returns the algorithm of given name, throws if there is no such algorithm.
+     */
+    static Kind Parse(std::string const & name);
+
+private:
+    Kind kind_;
+    MD5 md5_;
+    Murmur3 murmur3_;
+
+    static Kind algorithm_;
+};
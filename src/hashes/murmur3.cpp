@@ -0,0 +1,128 @@
+#include <cstring>
+
+#include "murmur3.h"
+
+namespace {
+
+    uint64_t const c1 = 0x87c37b91114253d5ULL;
+    uint64_t const c2 = 0x4cf5ad432745937fULL;
+
+    inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t fmix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    /** Reads little endian 64bit word.
+     */
+    inline uint64_t load(uint8_t const * from) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t result;
+        memcpy(& result, from, sizeof(result));
+        return result;
+#else
+        uint64_t result = 0;
+        for (int i = 7; i >= 0; --i)
+            result = (result << 8) | from[i];
+        return result;
+#endif
+    }
+
+    inline void store(uint64_t value, unsigned char * into) {
+        for (int i = 0; i < 8; ++i) {
+            into[i] = value & 0xff;
+            value >>= 8;
+        }
+    }
+
+}
+
+void Murmur3::add(void const * data, size_t numBytes) {
+    uint8_t const * p = static_cast<uint8_t const *>(data);
+    numBytes_ += numBytes;
+    // complete the partially filled block first
+    if (bufferSize_ > 0) {
+        size_t n = BlockSize - bufferSize_;
+        if (n > numBytes)
+            n = numBytes;
+        memcpy(buffer_ + bufferSize_, p, n);
+        bufferSize_ += n;
+        p += n;
+        numBytes -= n;
+        if (bufferSize_ < BlockSize)
+            return;
+        processBlock(buffer_);
+        bufferSize_ = 0;
+    }
+    while (numBytes >= BlockSize) {
+        processBlock(p);
+        p += BlockSize;
+        numBytes -= BlockSize;
+    }
+    if (numBytes > 0) {
+        memcpy(buffer_, p, numBytes);
+        bufferSize_ = numBytes;
+    }
+}
+
+void Murmur3::getHash(unsigned char buffer[HashBytes]) const {
+    uint64_t h1 = h1_;
+    uint64_t h2 = h2_;
+    // the tail, same as a zero padded block, but the mixing of each half is skipped if the half is empty
+    if (bufferSize_ > 0) {
+        uint8_t tail[BlockSize] = { 0 };
+        memcpy(tail, buffer_, bufferSize_);
+        if (bufferSize_ > 8) {
+            uint64_t k2 = load(tail + 8);
+            k2 *= c2;
+            k2 = rotl(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+        }
+        uint64_t k1 = load(tail);
+        k1 *= c1;
+        k1 = rotl(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+    h1 ^= numBytes_;
+    h2 ^= numBytes_;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    store(h1, buffer);
+    store(h2, buffer + 8);
+}
+
+void Murmur3::processBlock(uint8_t const * block) {
+    uint64_t k1 = load(block);
+    uint64_t k2 = load(block + 8);
+
+    k1 *= c1;
+    k1 = rotl(k1, 31);
+    k1 *= c2;
+    h1_ ^= k1;
+
+    h1_ = rotl(h1_, 27);
+    h1_ += h2_;
+    h1_ = h1_ * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = rotl(k2, 33);
+    k2 *= c1;
+    h2_ ^= k2;
+
+    h2_ = rotl(h2_, 31);
+    h2_ += h1_;
+    h2_ = h2_ * 5 + 0x38495ab5;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Streaming MurmurHash3, the x64 128bit variant.
+
+  The algorithm is Austin Appleby's public domain MurmurHash3_x64_128 with zero seed, reworked so that data can be added in arbitrarily sized pieces with the result identical to hashing them at once. It is not cryptographic, but an order of magnitude faster than MD5 while keeping 128bit digests.
+ */
+class Murmur3 {
+public:
+    enum { BlockSize = 16, HashBytes = 16 };
+
+    Murmur3() {
+        reset();
+    }
+
+    void reset() {
+        h1_ = 0;
+        h2_ = 0;
+        numBytes_ = 0;
+        bufferSize_ = 0;
+    }
+
+    void add(void const * data, size_t numBytes);
+
+    /** Stores the hash of all data added so far into the buffer. More data can be added afterwards.
+     */
+    void getHash(unsigned char buffer[HashBytes]) const;
+
+private:
+    void processBlock(uint8_t const * block);
+
+    uint64_t h1_;
+    uint64_t h2_;
+    uint64_t numBytes_;
+    size_t bufferSize_;
+    uint8_t buffer_[BlockSize];
+};
@@ -0,0 +1,164 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "config.h"
+#include "utils.h"
+
+#include "input.h"
+
+bool InputBuffer::open(std::string const & filename) {
+    close();
+    filename_ = filename;
+    fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        filename_ = filename + COMPRESSED_EXT;
+        fd_ = ::open(filename_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            return false;
+    }
+    pos_ = 0;
+    consumed_ = 0;
+    fileEnd_ = false;
+    inMember_ = false;
+    if (data_ == nullptr)
+        data_.reset(new char[capacity_]);
+    size_ = readFile(data_.get(), capacity_);
+    // gzip magic, the chunk read so far becomes the compressed input
+    if (size_ < 2 or static_cast<unsigned char>(data_[0]) != 0x1f or static_cast<unsigned char>(data_[1]) != 0x8b)
+        return true;
+    if (compressed_ == nullptr)
+        compressed_.reset(new char[capacity_]);
+    std::swap(data_, compressed_);
+    inflate_ = new z_stream();
+    // 32 added to the window bits detects gzip header, 16 would require it
+    if (inflateInit2(inflate_, 15 + 32) != Z_OK) {
+        delete inflate_;
+        inflate_ = nullptr;
+        throw STR("Unable to initialize decompression of " << filename_);
+    }
+    inflate_->next_in = reinterpret_cast<Bytef *>(compressed_.get());
+    inflate_->avail_in = size_;
+    size_ = 0;
+    return true;
+}
+
+void InputBuffer::close() {
+    if (fd_ < 0)
+        return;
+    if (inflate_ != nullptr) {
+        inflateEnd(inflate_);
+        delete inflate_;
+        inflate_ = nullptr;
+    }
+    ::close(fd_);
+    fd_ = -1;
+    pos_ = 0;
+    size_ = 0;
+}
+
+size_t InputBuffer::read(char * into, size_t size) {
+    size_t result = 0;
+    while (result < size) {
+        if (pos_ == size_ and not fill())
+            break;
+        size_t n = std::min(size - result, size_ - pos_);
+        memcpy(into + result, data_.get() + pos_, n);
+        pos_ += n;
+        result += n;
+    }
+    return result;
+}
+
+uint64_t InputBuffer::skip(uint64_t size) {
+    uint64_t result = 0;
+    while (result < size) {
+        if (pos_ == size_ and not fill())
+            break;
+        size_t n = std::min<uint64_t>(size - result, size_ - pos_);
+        pos_ += n;
+        result += n;
+    }
+    return result;
+}
+
+bool InputBuffer::readLine(std::string & into) {
+    into.clear();
+    while (true) {
+        if (pos_ == size_ and not fill())
+            return not into.empty();
+        char const * start = data_.get() + pos_;
+        char const * end = static_cast<char const *>(memchr(start, '\n', size_ - pos_));
+        if (end != nullptr) {
+            into.append(start, end - start);
+            pos_ += end - start + 1;
+            return true;
+        }
+        // the line continues in the next chunk
+        into.append(start, size_ - pos_);
+        pos_ = size_;
+    }
+}
+
+bool InputBuffer::fill() {
+    if (fd_ < 0)
+        return false;
+    consumed_ += size_;
+    pos_ = 0;
+    size_ = 0;
+    if (inflate_ == nullptr)
+        size_ = readFile(data_.get(), capacity_);
+    else
+        inflate();
+    return size_ > 0;
+}
+
+void InputBuffer::inflate() {
+    while (size_ == 0) {
+        if (inflate_->avail_in == 0) {
+            if (not fileEnd_) {
+                size_t n = readFile(compressed_.get(), capacity_);
+                inflate_->next_in = reinterpret_cast<Bytef *>(compressed_.get());
+                inflate_->avail_in = n;
+                fileEnd_ = n == 0;
+            }
+            if (fileEnd_) {
+                if (inMember_)
+                    throw STR("Truncated compressed file " << filename_);
+                return;
+            }
+        }
+        inflate_->next_out = reinterpret_cast<Bytef *>(data_.get());
+        inflate_->avail_out = capacity_;
+        inMember_ = true;
+        int status = ::inflate(inflate_, Z_NO_FLUSH);
+        size_ = capacity_ - inflate_->avail_out;
+        if (status == Z_STREAM_END) {
+            // concatenated gzip members, such as appended output, continue with the next member
+            inflateReset(inflate_);
+            inMember_ = false;
+        } else if (status != Z_OK and status != Z_BUF_ERROR) {
+            throw STR("Corrupted compressed file " << filename_);
+        }
+    }
+}
+
+size_t InputBuffer::readFile(char * into, size_t size) {
+    size_t result = 0;
+    while (result < size) {
+        ssize_t n = ::read(fd_, into + result, size - result);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw STR("Unable to read file " << filename_);
+        }
+        if (n == 0)
+            break;
+        result += n;
+    }
+    return result;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct z_stream_s;
+
+/** Buffered sequential input from the tokenizer's output files.
+
+  The file is read in chunks of the buffer's capacity. If it is gzip compressed, which is recognized by its magic rather than its name, the chunks are inflated into the buffer as they are read, concatenated gzip members such as appended output reading as a single stream. Either way, no more than two buffers of the file are in memory at any time, however large the file.
+
+  Errors when reading or decompressing the file are thrown.
+ */
+class InputBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    /** The buffer is only allocated when the file is opened.
+     */
+    explicit InputBuffer(size_t capacity = DEFAULT_CAPACITY):
+        fd_(-1),
+        inflate_(nullptr),
+        pos_(0),
+        size_(0),
+        capacity_(capacity),
+        consumed_(0),
+        fileEnd_(false),
+        inMember_(false) {
+    }
+
+    InputBuffer(InputBuffer const &) = delete;
+    InputBuffer & operator = (InputBuffer const &) = delete;
+
+    ~InputBuffer() {
+        close();
+    }
+
+    /** Opens given output file for reading.
+
+      If the file does not exist, its compressed version (with COMPRESSED_EXT appended) is opened instead. Returns false if neither can be opened.
+     */
+    bool open(std::string const & filename);
+
+    void close();
+
+    std::string const & filename() const {
+        return filename_;
+    }
+
+    /** Returns true if all contents have been read.
+     */
+    bool eof() {
+        return pos_ == size_ and not fill();
+    }
+
+    /** Number of (uncompressed) bytes read so far.
+     */
+    uint64_t offset() const {
+        return consumed_ + pos_;
+    }
+
+    /** Reads a single byte. Returns false at the end of the file.
+     */
+    bool get(char & c) {
+        if (pos_ == size_ and not fill())
+            return false;
+        c = data_[pos_++];
+        return true;
+    }
+
+    /** Reads up to given number of bytes. Returns the number of bytes read, which is smaller only at the end of the file.
+     */
+    size_t read(char * into, size_t size);
+
+    /** Skips up to given number of bytes. Returns the number of bytes skipped, which is smaller only at the end of the file.
+     */
+    uint64_t skip(uint64_t size);
+
+    /** Reads the next line, without the line terminator. Returns false at the end of the file.
+     */
+    bool readLine(std::string & into);
+
+private:
+    /** Replaces the buffer with the next chunk of the contents. Returns false if there are no more.
+     */
+    bool fill();
+
+    /** Inflates the compressed input into the buffer until it holds something, reading more of the file as needed.
+     */
+    void inflate();
+
+    size_t readFile(char * into, size_t size);
+
+    int fd_;
+    std::string filename_;
+    z_stream_s * inflate_;
+    std::unique_ptr<char[]> data_;
+    std::unique_ptr<char[]> compressed_;
+    size_t pos_;
+    size_t size_;
+    size_t capacity_;
+
+    /** Bytes of the contents before the buffer.
+     */
+    uint64_t consumed_;
+
+    bool fileEnd_;
+
+    /** True while a gzip member is started and not finished yet, so that a truncated file can be told from a complete one.
+     */
+    bool inMember_;
+};
+
+/** Calls the function for each line of the input, without the line terminator. Stops at first empty line.
+ */
+template<typename FUNCTION>
+void forEachLine(InputBuffer & input, FUNCTION f) {
+    std::string line;
+    while (input.readLine(line)) {
+        if (line.empty())
+            break; // eof
+        f(line);
+    }
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
@@ -6,9 +7,12 @@
 #include "data.h"
 #include "validator.h"
 #include "crawler.h"
+#include "reader.h"
 #include "tokenizer.h"
 #include "merger.h"
 #include "writer.h"
+#include "manifest.h"
+#include "checkpoint.h"
 
 #include "escape_codes.h"
 
@@ -26,6 +30,7 @@ void help() {
 
 void displayStats(double duration) {
     Worker::Stats c = Crawler::Statistic();
+    Worker::Stats r = Reader::Statistic();
     Worker::Stats t = Tokenizer::Statistic();
     Worker::Stats m = Merger::Statistic();
     Worker::Stats w = Writer::Statistic();
@@ -35,23 +40,27 @@ void displayStats(double duration) {
 
     std::cout << "Active threads " << Worker::NumActiveThreads() << std::endl;
     std::cout << "Crawler        " << c << std::endl;
+    std::cout << "Reader         " << r << std::endl;
     std::cout << "Tokenizer      " << t << std::endl;
     std::cout << "Merger         " << m << std::endl;
     std::cout << "Writer         " << w << std::endl << std::endl;
 
     std::cout << "Files      "
+              << std::setw(8) << Reader::ProcessedFiles() << " reader"
               << std::setw(8) << Tokenizer::ProcessedFiles() << " tokenizer"
               << std::setw(8) << Merger::ProcessedFiles() << " merger"
               << std::setw(8) << Writer::ProcessedFiles() << " writer"
               << std::endl;
 
     std::cout << "Bytes      " << std::setprecision(2) << std::fixed
+              << std::setw(8) << Reader::ProcessedMBytes() << " reader"
               << std::setw(8) << Tokenizer::ProcessedMBytes() << " tokenizer"
               << std::setw(8) << Merger::ProcessedMBytes() << " merger"
               << std::setw(8) << Writer::ProcessedMBytes() << " writer [MB]"
               << std::endl;
 
     std::cout << "Throughput "
+              << std::setw(8) << (Reader::ProcessedMBytes() / duration) << " reader"
               << std::setw(8) << (Tokenizer::ProcessedMBytes() / duration) << " tokenizer"
               << std::setw(8) << (Merger::ProcessedMBytes() / duration) << " merger"
               << std::setw(8) << (Writer::ProcessedMBytes() / duration) << " writer [MB/s]"
@@ -60,8 +69,10 @@ void displayStats(double duration) {
     std::cout << "Unique tokens     " << Merger::NumUniqueTokens() << std::endl;
     std::cout << "Empty files       " << Merger::NumEmptyFiles() << pct(Merger::NumEmptyFiles(), Merger::ProcessedFiles()) << std::endl;
     std::cout << "Detected clones   " << Merger::NumClones() << pct(Merger::NumClones(), Merger::ProcessedFiles()) << std::endl;
+    std::cout << "Reused files      " << Merger::NumReused() << pct(Merger::NumReused(), Merger::NumReuseLookups()) << std::endl;
+    std::cout << "Unchanged         " << Manifest::NumUnchangedFiles() << " files, " << Manifest::NumUnchangedProjects() << " projects" << std::endl;
     std::cout << "JS errors         " << Tokenizer::jsErrors() << pct(Tokenizer::jsErrors(), Tokenizer::ProcessedFiles()) << std::endl;
-    std::cout << cursorUp(16);
+    std::cout << cursorUp(19);
     Worker::UnlockOutput();
 }
 
@@ -74,35 +85,116 @@ void tokenize(int argc, char * argv[]) {
     }
 
     Crawler::SetQueueLimit(10000);
+    Reader::SetQueueLimit(10000);
     Tokenizer::SetQueueLimit(10000);
     Merger::SetQueueLimit(10000);
     Writer::SetQueueLimit(10000);
 
+    // files move between the stages in batches, directories and projects one by one, --batch= sets all batch sizes, --tokenizer-batch=, --merger-batch= and --writer-batch= a single stage's
+    Tokenizer::BatchSize() = 64;
+    Merger::BatchSize() = 256;
+    Writer::BatchSize() = 256;
 
     std::string outdir = argv[2];
+    unsigned writers = 4;
+    bool incremental = false;
+    bool resume = false;
+
+    for (unsigned i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.find("--hash=") == 0)
+            Hasher::Algorithm() = Hasher::Parse(arg.substr(7));
+        else if (arg.find("--format=") == 0)
+            Writer::OutputFormat() = Writer::ParseFormat(arg.substr(9));
+        else if (arg == "--compress")
+            Writer::CompressionLevel() = 1;
+        else if (arg.find("--compress=") == 0)
+            Writer::CompressionLevel() = std::stoi(arg.substr(11));
+        else if (arg == "--from-git")
+            Reader::FromGit() = true;
+        else if (arg.find("--mmap-threshold=") == 0)
+            FileBuffer::MmapThreshold() = std::stoul(arg.substr(17)) * 1024;
+        else if (arg.find("--summary-cache=") == 0)
+            Merger::SetSummaryCacheSize(std::stoul(arg.substr(16)));
+        else if (arg.find("--history-cache=") == 0)
+            Reader::HistoryCache() = arg.substr(16);
+        else if (arg == "--incremental")
+            incremental = true;
+        else if (arg.find("--checkpoint=") == 0)
+            Checkpoint::Interval() = std::stoul(arg.substr(13));
+        else if (arg == "--resume")
+            resume = true;
+        else if (arg.find("--writers=") == 0)
+            writers = std::max(std::stoi(arg.substr(10)), 1);
+        else if (arg.find("--batch=") == 0)
+            Tokenizer::BatchSize() = Merger::BatchSize() = Writer::BatchSize() = std::stoul(arg.substr(8));
+        else if (arg.find("--tokenizer-batch=") == 0)
+            Tokenizer::BatchSize() = std::stoul(arg.substr(18));
+        else if (arg.find("--merger-batch=") == 0)
+            Merger::BatchSize() = std::stoul(arg.substr(15));
+        else if (arg.find("--writer-batch=") == 0)
+            Writer::BatchSize() = std::stoul(arg.substr(15));
+        else if (arg.find("--projects-file=") == 0)
+            Crawler::Schedule(CrawlerJob::ProjectsFile(arg.substr(16)));
+        else if (arg.find("--shard=") == 0)
+            Crawler::SetShard(arg.substr(8));
+        else if (not isDirectory(arg))
+            throw STR("Input directory " << arg << " not found");
+        else
+            Crawler::Schedule(CrawlerJob(arg));
+    }
 
-    for (unsigned i = 3; i < argc; ++i)
-        Crawler::Schedule(CrawlerJob(argv[i]));
+    if (not Reader::HistoryCache().empty())
+        createDirectory(Reader::HistoryCache());
+
+    // previous output must be loaded before any project is read, an interrupted run continues from its last checkpoint like an incremental run
+    if (resume)
+        Checkpoint::Restore(outdir);
+    Writer::initializeOutputDirectory(outdir, incremental or resume);
+    if (incremental or resume)
+        Manifest::Load(outdir);
+    if (incremental and not resume)
+        Merger::LoadGlobalTokens(STR(outdir << "/" << GLOBAL_TOKENS_FILE));
+    Manifest::Open(outdir);
+    if (Checkpoint::Interval() > 0)
+        createDirectory(outdir + "/" + PATH_CHECKPOINT);
 
     start = std::chrono::high_resolution_clock::now();
 
 
 
     Crawler::initializeWorkers(8);
+    Reader::initializeWorkers(8);
     Tokenizer::initializeWorkers(8);
     Merger::initializeWorkers(8);
-    Writer::initializeOutputDirectory(outdir);
-    Writer::initializeWorkers(1);
+    Writer::initializeWorkers(writers);
 
+    double lastCheckpoint = 0;
     do {
         displayStats(secondsSince(start));
+        if (Checkpoint::Interval() > 0 and secondsSince(start) - lastCheckpoint >= Checkpoint::Interval()) {
+            Checkpoint::Take(outdir);
+            lastCheckpoint = secondsSince(start);
+        }
     } while (not Worker::WaitForFinished(1000));
 
     displayStats(secondsSince(start));
-    std::cout << cursorDown(15);
+    std::cout << cursorDown(18);
+    Writer::closeOutput();
+    Manifest::Close();
     Worker::Log("ALL DONE");
-    std::ofstream tokens(STR(outdir << "/tokens.txt"));
-    Merger::writeGlobalTokens(tokens);
+    if (Writer::OutputFormat() != Writer::Format::binary) {
+        OutputBuffer tokens;
+        Writer::createOutputFile(tokens, STR(outdir << "/" << GLOBAL_TOKENS_FILE << GLOBAL_TOKENS_FILE_EXT));
+        Merger::writeGlobalTokens(tokens);
+    }
+    if (Writer::OutputFormat() != Writer::Format::text) {
+        OutputBuffer tokens;
+        Writer::createOutputFile(tokens, STR(outdir << "/" << GLOBAL_TOKENS_FILE << BINARY_EXT));
+        Merger::writeGlobalTokensBinary(tokens);
+    }
+    if (Checkpoint::Interval() > 0 or resume)
+        Checkpoint::Remove(outdir);
 }
 
 
@@ -131,6 +223,16 @@ void validate(int argc, char * argv[]) {
 
 
 
+/** Converts binary tokenizer output in given directory to the sourcererCC's text format.
+ */
+void convert(int argc, char * argv[]) {
+    if (argc < 3) {
+        help();
+        throw STR("Invalid number of arguments");
+    }
+    Writer::ConvertToText(argv[2]);
+}
+
 void process(int argc, char * argv[]) {
 
 }
@@ -148,6 +250,8 @@ int main(int argc, char * argv[]) {
             tokenize(argc, argv);
         } else if (cmd == "validate" or cmd == "--validate" or cmd == "-v") {
             validate(argc, argv);
+        } else if (cmd == "convert" or cmd == "--convert" or cmd == "-c") {
+            convert(argc, argv);
         } else if (cmd == "process" or cmd == "--process" or cmd == "-p") {
             process(argc, argv);
         } else {
@@ -0,0 +1,90 @@
+#include "merger.h"
+#include "writer.h"
+
+#include "manifest.h"
+
+std::unordered_map<std::string, Manifest::Project> Manifest::projects_;
+bool Manifest::loaded_ = false;
+
+std::mutex Manifest::m_;
+OutputBuffer Manifest::heads_;
+
+std::atomic_uint Manifest::unchangedProjects_(0);
+std::atomic_uint Manifest::unchangedFiles_(0);
+
+void Manifest::Load(std::string const & outputDir) {
+    unsigned shards = Writer::NumShards(outputDir);
+    if (not isOutputFile(STR(outputDir << "/" << PATH_MANIFEST << "/" << MANIFEST_FILE << 0 << MANIFEST_FILE_EXT)))
+        throw STR("No manifest found in " << outputDir);
+    for (unsigned i = 0; i < shards; ++i)
+        GitProject::parseFile(STR(outputDir << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << i << BOOKKEEPING_PROJS_EXT));
+    for (unsigned i = 0, e = GitProject::NumProjects(); i < e; ++i) {
+        GitProject * p = GitProject::Get(i + PROJECT_ID_STARTS_AT);
+        if (p != nullptr)
+            projects_[p->path()].pid = p->id();
+    }
+    // later records of the same project override the earlier ones
+    InputBuffer f;
+    if (f.open(STR(outputDir << "/" << PATH_MANIFEST << "/" << MANIFEST_HEADS_FILE << MANIFEST_HEADS_FILE_EXT))) {
+        forEachLine(f, [] (std::string const & line) {
+            std::vector<std::string> items(split(line, ','));
+            GitOid head;
+            if (items.size() != 2 or not head.parse(items[0].c_str()))
+                throw STR("Invalid line format of manifest heads: " << line);
+            projects_[unescapePath(items[1])].head = head;
+        });
+    }
+    for (unsigned i = 0; i < shards; ++i) {
+        std::string filename = STR(outputDir << "/" << PATH_MANIFEST << "/" << MANIFEST_FILE << i << MANIFEST_FILE_EXT);
+        if (not f.open(filename))
+            throw STR("Unable to open manifest " << filename);
+        forEachLine(f, [] (std::string const & line) {
+            // fid, pid, original, contents hash, clone digest, relative path
+            std::vector<std::string> items(split(line, ','));
+            Digest contents;
+            Digest digest;
+            if (items.size() != 6 or not contents.parse(items[3]) or not digest.parse(items[4]))
+                throw STR("Invalid line format of manifest: " << line);
+            unsigned fid = std::stoul(items[0]);
+            unsigned pid = std::stoul(items[1]);
+            GitProject * p = pid - PROJECT_ID_STARTS_AT < GitProject::NumProjects() ? GitProject::Get(pid) : nullptr;
+            if (p == nullptr)
+                throw STR("Manifest refers to unknown project " << pid);
+            auto & file = projects_[p->path()].files[unescapePath(items[5])];
+            if (fid > file.second)
+                file = std::make_pair(contents, fid);
+            Merger::RestoreFile(digest, pid, fid, items[2] == "1");
+        });
+    }
+    loaded_ = true;
+}
+
+void Manifest::Open(std::string const & outputDir) {
+    Writer::openOutputFile(heads_, STR(outputDir << "/" << PATH_MANIFEST << "/" << MANIFEST_HEADS_FILE << MANIFEST_HEADS_FILE_EXT));
+}
+
+void Manifest::Close() {
+    std::lock_guard<std::mutex> g(m_);
+    heads_.close();
+}
+
+bool Manifest::Unchanged(TokenizedFile const * tf) {
+    auto i = projects_.find(tf->project()->path());
+    if (i == projects_.end())
+        return false;
+    auto j = i->second.files.find(tf->stats.relPath());
+    if (j == i->second.files.end() or j->second.first != tf->contentsHash)
+        return false;
+    ++unchangedFiles_;
+    return true;
+}
+
+void Manifest::AddProject(std::string const & path, GitOid const & head) {
+    std::lock_guard<std::mutex> g(m_);
+    heads_ << head.hex() << "," << escapePath(path) << '\n';
+}
+
+void Manifest::Sync(std::function<void(std::string const &, uint64_t)> f) {
+    std::lock_guard<std::mutex> g(m_);
+    f(heads_.filename(), heads_.sync());
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "data.h"
+#include "git.h"
+#include "output.h"
+
+/** Manifest of the projects and files already in the output, see PATH_MANIFEST.
+
+  The writers record every file they write in the manifest of their shard and the HEAD of every project is recorded once all its files were written, so the manifest is always written. An incremental run loads it and then skips projects whose HEAD did not change, and files whose contents at the same path did not change, keeping the ids of known projects. Files removed from a project since the previous run stay in the output. Files whose contents were not hashed, see Tokenizer::process(), are recorded with an empty hash and are tokenized again by the next incremental run.
+
+  The loaded manifest is only read while the files are processed and needs no locking.
+ */
+class Manifest {
+public:
+    /** Loads the manifest and the ids of the projects from the output of previous runs, restoring the clone index and ids of the merger as well.
+     */
+    static void Load(std::string const & outputDir);
+
+    /** Opens the heads file of the manifest, appending to it if the output is appended to.
+     */
+    static void Open(std::string const & outputDir);
+
+    static void Close();
+
+    /** Returns true if the manifest of previous runs was loaded, i.e. the run is incremental or resumed.
+     */
+    static bool Loaded() {
+        return loaded_;
+    }
+
+    /** Returns true if the project was already read at given HEAD.
+     */
+    static bool Unchanged(std::string const & path, GitOid const & head) {
+        auto i = projects_.find(path);
+        return i != projects_.end() and i->second.head == head;
+    }
+
+    /** Returns the id of the project from the previous runs, or 0 if the project is new.
+     */
+    static unsigned ProjectId(std::string const & path) {
+        auto i = projects_.find(path);
+        return i == projects_.end() ? 0 : i->second.pid;
+    }
+
+    /** Returns true if a file with the same path and contents was already written. The contents must be hashed.
+     */
+    static bool Unchanged(TokenizedFile const * tf);
+
+    /** Records the HEAD at which the project was read, once all its files were written, see GitProject::release().
+     */
+    static void AddProject(std::string const & path, GitOid const & head);
+
+    /** Writes the heads file to disk and calls the function with its name and size.
+     */
+    static void Sync(std::function<void(std::string const &, uint64_t)> f);
+
+    /** Number of projects skipped because their HEAD did not change.
+     */
+    static std::atomic_uint & NumUnchangedProjects() {
+        return unchangedProjects_;
+    }
+
+    /** Number of files skipped because their contents did not change.
+     */
+    static std::atomic_uint & NumUnchangedFiles() {
+        return unchangedFiles_;
+    }
+
+private:
+    struct Project {
+        unsigned pid = 0;
+        GitOid head;
+        /** Hash of contents and the id of the latest file at each path.
+         */
+        std::unordered_map<std::string, std::pair<Digest, unsigned>> files;
+    };
+
+    static std::unordered_map<std::string, Project> projects_;
+    static bool loaded_;
+
+    static std::mutex m_;
+    static OutputBuffer heads_;
+
+    static std::atomic_uint unchangedProjects_;
+    static std::atomic_uint unchangedFiles_;
+};
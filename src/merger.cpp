@@ -1,7 +1,9 @@
 #include <thread>
 #include <iomanip>
+#include <algorithm>
 #include "merger.h"
 #include "writer.h"
+#include "binary.h"
 
 
 /** Possible merger speedups:
@@ -25,17 +27,18 @@ unsigned Merger::pid_(PROJECT_ID_STARTS_AT);
 
 
 Merger::StopClones Merger::stopClones_ = Merger::StopClones::tokens;
-std::unordered_map<std::string, Merger::CloneInfo> Merger::clones_;
+CloneIndex Merger::clones_;
 //std::unordered_map<std::string, Merger::TokenInfo> Merger::uniqueTokenIds_;
 
 
-std::unordered_map<std::string, unsigned> Merger::tokenIds_;
-std::vector<unsigned> Merger::tokenCounts_(1024);
+TokenDictionary Merger::tokenIds_;
+SummaryCache<GitOid> Merger::blobs_;
+SummaryCache<Digest> Merger::contents_;
+std::vector<std::vector<unsigned> *> Merger::tokenCounts_;
+std::vector<unsigned> Merger::loadedCounts_;
 
 
 
-std::mutex Merger::accessC_;
-std::mutex Merger::accessTid_;
 std::mutex Merger::accessTc_;
 std::mutex Merger::accessPid_;
 
@@ -43,6 +46,13 @@ std::atomic_uint Merger::numClones_(0);
 std::atomic_uint Merger::numEmptyFiles_(0);
 std::atomic_uint Merger::numErrorFiles_(0);
 
+Merger::Merger(unsigned index):
+    QueueProcessor<MergerJob>(STR("MERGER " << index)),
+    counts_(1024) {
+    std::lock_guard<std::mutex> g(accessTc_);
+    tokenCounts_.push_back(& counts_);
+}
+
 void Merger::initializeWorkers(unsigned num) {
     for (unsigned i = 0; i < num; ++i) {
         std::thread t([i] () {
@@ -53,113 +63,121 @@ void Merger::initializeWorkers(unsigned num) {
     }
 }
 
-void Merger::writeGlobalTokens(std::ostream & s) {
-    for (auto i : tokenIds_) {
-        s << i.second << ","
-          << tokenCounts_[i.second] << ","
-          << i.first.size() << ","
-          << escapeToken(i.first) << std::endl;
-    }
+std::vector<unsigned> Merger::globalTokenCounts() {
+    // merge the token counts of all merger threads
+    std::vector<unsigned> counts(tokenIds_.size());
+    for (std::vector<unsigned> * c : tokenCounts_)
+        for (size_t i = 0, e = std::min(c->size(), counts.size()); i != e; ++i)
+            counts[i] += (*c)[i];
+    return counts;
 }
 
-Merger::CloneInfo Merger::checkClones(TokenizedFile * tf) {
-    if (stopClones_ == StopClones::none)
-        return CloneInfo();
-    std::string const & hash = stopClones_ == StopClones::file ? tf->stats.fileHash() : tf->stats.tokensHash();
-    accessC_.lock();
-    auto i = clones_.find(hash);
-    if (i == clones_.end()) {
-        clones_[hash] = CloneInfo(tf->pid(), tf->id());
-        accessC_.unlock();
-        return CloneInfo();
-    } else {
-        accessC_.unlock();
-        ++numClones_;
-        Writer::Log("clone");
-        return i->second;
-    }
-}
-
-// TODO these are dumb for now
-void Merger::lockTokenIdRead() {
-    accessTid_.lock();
+void Merger::writeGlobalTokens(OutputBuffer & s) {
+    std::vector<unsigned> counts(globalTokenCounts());
+    tokenIds_.forEach([&s, &counts] (TokenView const & token, unsigned id) {
+        s << id << ","
+          << counts[id] << ","
+          << token.size << ","
+          << escapeToken(token.str()) << '\n';
+    });
 }
 
-void Merger::unlockTokenIdRead() {
-    accessTid_.unlock();
+void Merger::writeGlobalTokensBinary(OutputBuffer & s) {
+    std::vector<unsigned> counts(globalTokenCounts());
+    s.append(GLOBAL_TOKENS_BINARY_MAGIC, strlen(GLOBAL_TOKENS_BINARY_MAGIC));
+    tokenIds_.forEach([&s, &counts] (TokenView const & token, unsigned id) {
+        s.appendVarint(id);
+        s.appendVarint(counts[id]);
+        s.appendVarint(token.size);
+        s.append(token.data, token.size);
+    });
 }
 
-void Merger::lockTokenIdWrite() {
-    accessTid_.lock();
-}
-
-void Merger::unlockTokenIdWrite() {
-    accessTid_.unlock();
+void Merger::LoadGlobalTokens(std::string const & filename) {
+    auto add = [] (unsigned id, unsigned count, std::string const & token) {
+        tokenIds_.insert(TokenView(token.c_str(), token.size()), id);
+        if (id >= loadedCounts_.size())
+            loadedCounts_.resize(id + 1);
+        loadedCounts_[id] = count;
+    };
+    if (isOutputFile(filename + GLOBAL_TOKENS_FILE_EXT)) {
+        InputBuffer f;
+        f.open(filename + GLOBAL_TOKENS_FILE_EXT);
+        forEachLine(f, [& add] (std::string const & line) {
+            // id, count, size and the escaped token, which contains no commas
+            std::vector<std::string> items(split(line, ','));
+            if (items.size() != 4)
+                throw STR("Invalid line format of global tokens: " << line);
+            add(std::stoul(items[0]), std::stoul(items[1]), unescapePath(items[3]));
+        });
+    } else {
+        DictionaryReader dictionary(filename + BINARY_EXT);
+        unsigned id;
+        unsigned count;
+        std::string token;
+        while (dictionary.next(id, count, token))
+            add(id, count, token);
+    }
+    std::lock_guard<std::mutex> g(accessTc_);
+    tokenCounts_.push_back(& loadedCounts_);
 }
 
-void Merger::lockCounts() {
-    accessTc_.lock();
+void Merger::RestoreFile(Digest const & digest, unsigned pid, unsigned fid, bool original) {
+    unsigned originalPid;
+    unsigned originalFid;
+    if (original and stopClones_ != StopClones::none)
+        clones_.insert(digest, pid, fid, originalPid, originalFid);
+    if (fid >= fid_)
+        fid_ = fid + 1;
+    if (pid >= pid_)
+        pid_ = pid + 1;
 }
 
-void Merger::unlockCounts() {
-    accessTc_.unlock();
+Merger::CloneInfo Merger::checkClones(TokenizedFile * tf) {
+    if (stopClones_ == StopClones::none)
+        return CloneInfo();
+    Digest const & hash = CloneDigest(tf);
+    CloneInfo original;
+    if (clones_.insert(hash, tf->pid(), tf->id(), original.pid, original.fid))
+        return CloneInfo();
+    ++numClones_;
+    Writer::Log("clone");
+    return original;
 }
 
 void Merger::tokensToIds(TokenizedFile * tf) {
-    std::map<unsigned, unsigned> matched;
-    TokenMap missing;
+    std::vector<std::pair<uint32_t, uint32_t>> & ids = tf->ids.freqs_;
+    ids.reserve(tf->tokens.size());
 
-    // first get id's of tokens that are definitely in the map already
-    // many threads can do this at the same time
-    lockTokenIdRead();
+    // get id's of the tokens, the dictionary is sharded so that threads rarely wait for each other
     for (auto i : tf->tokens) {
-        auto j = tokenIds_.find(i.first);
-        if (j == tokenIds_.end())
-            missing.add(i.first, i.second);
-        else
-            matched[j->second] = i.second;
-    }
-    unlockTokenIdRead();
-
-    // now obtain id's for those that were not in the map the first time, note someone might have added them in the meantime
-    // only one thread can do this at a time
-    lockTokenIdWrite();
-    for (auto i : missing) {
-        auto j = tokenIds_.find(i.first);
-        if (j == tokenIds_.end()) {
-            unsigned id = tokenIds_.size();
-            tokenIds_[i.first] = id;
-            matched[id] = i.second;
-        } else {
-            matched[j->second] = i.second;
-        }
+        unsigned id = tokenIds_.idFor(i.first);
+        ids.push_back(std::pair<uint32_t, uint32_t>(id, i.second));
+        // update the token counts of this thread, these are merged only when the tokens are written
+        if (id >= counts_.size())
+            counts_.resize(std::max<size_t>(id + 1, counts_.size() * 2));
+        counts_[id] += i.second;
     }
-    unlockTokenIdWrite();
+    std::sort(ids.begin(), ids.end());
 
-    // now get the largest id we have
-    unsigned maxId = 0;
-    for (auto i : matched) {
-        if (i.first > maxId)
-            maxId = i.first;
-    }
+    // the tokens and the contents they point to are no longer needed
+    tf->tokens.clear();
+    tf->contents.clear();
+}
 
-    // update token counts
-    // only one thread can do this at a time
-    lockCounts();
-    // resize if needed
-    while (maxId >= tokenCounts_.size()) {
-        int x = tokenCounts_.size();
-        tokenCounts_.resize(tokenCounts_.size() * 2);
-    }
-    // update the counts
-    for (auto i : matched)
-        tokenCounts_[i.first] += i.second;
-    unlockCounts();
+bool Merger::ReuseContents(TokenizedFile * tf) {
+    if (not contents_.reuse(tf->contentsHash, tf))
+        return false;
+    tf->contents.clear();
+    return true;
+}
 
-    // convert the token id's and counts back into token map
-    tf->tokens.clear();
-    for (auto i : matched)
-        tf->tokens.add(STR(std::hex << i.first), i.second);
+void Merger::countIds(TokenizedFile * tf) {
+    for (auto i : tf->ids) {
+        if (i.first >= counts_.size())
+            counts_.resize(std::max<size_t>(i.first + 1, counts_.size() * 2));
+        counts_[i.first] += i.second;
+    }
 }
 
 
@@ -168,8 +186,11 @@ void Merger::process(MergerJob const & job) {
     TokenizedFile * tf = job.file;
     bool writeProject = false;
 
-    // convert tokens to unique ids
-    tokensToIds(tf);
+    // convert tokens to unique ids, files reusing an identical file already have them
+    if (tf->reused)
+        countIds(tf);
+    else
+        tokensToIds(tf);
 
     // get file id's
     tf->setId(fid_++);
@@ -183,7 +204,13 @@ void Merger::process(MergerJob const & job) {
     accessPid_.unlock();
 
     // calculate hash for the tokens and determine if the file is a clone of someone
-    tf->calculateTokensHash();
+    if (not tf->reused) {
+        tf->calculateTokensHash();
+        if (tf->blob != GitOid())
+            blobs_.insert(tf->blob, tf);
+        else if (tf->contentsHash != Digest())
+            contents_.insert(tf->contentsHash, tf);
+    }
     CloneInfo ci = checkClones(tf);
 
     // update statistics
@@ -195,5 +222,5 @@ void Merger::process(MergerJob const & job) {
         ++numEmptyFiles_;
 
     // schedule writing of the file
-    Writer::Schedule(WriterJob(job.file, writeProject, ci.pid, ci.fid));
+    Writer::ScheduleBuffered(WriterJob(job.file, writeProject, ci.pid, ci.fid));
 }
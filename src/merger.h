@@ -4,6 +4,9 @@
 #include <unordered_map>
 
 #include "data.h"
+#include "clones.h"
+#include "dictionary.h"
+#include "summaries.h"
 #include "worker.h"
 
 struct MergerJob {
@@ -28,20 +31,74 @@ public:
         file
     };
 
-    Merger(unsigned index):
-        QueueProcessor<MergerJob>(STR("MERGER " << index)) {
-    }
+    Merger(unsigned index);
 
     static void initializeWorkers(unsigned num);
 
-    static void writeGlobalTokens(std::ostream & s);
+    static void writeGlobalTokens(OutputBuffer & s);
+
+    /** Writes the global tokens in the binary format, see DictionaryReader.
+     */
+    static void writeGlobalTokensBinary(OutputBuffer & s);
+
+    /** If a file with the same git blob has already been interned, makes the file reuse it so that it need not be tokenized and returns true.
+     */
+    static bool ReuseBlob(GitOid const & blob, TokenizedFile * tf) {
+        return blobs_.reuse(blob, tf);
+    }
+
+    /** If a file with the same contents has already been interned, makes the file reuse it so that it need not be tokenized and returns true.
+
+      The file must be read from the working tree, not yet tokenized, and its contents hashed.
+     */
+    static bool ReuseContents(TokenizedFile * tf);
+
+    /** Returns false if reusing of files with identical contents is disabled, in which case the contents need not be hashed for it.
+     */
+    static bool ContentsCacheEnabled() {
+        return contents_.capacity() > 0;
+    }
+
+    /** Sets the maximum size of the token ids in each of the summary caches, 0 disables reusing of identical files.
+     */
+    static void SetSummaryCacheSize(size_t mbytes) {
+        blobs_.setCapacity(mbytes * 1024 * 1024 / sizeof(std::pair<uint32_t, uint32_t>));
+        contents_.setCapacity(mbytes * 1024 * 1024 / sizeof(std::pair<uint32_t, uint32_t>));
+    }
+
+    /** Number of files looked up in the summary caches.
+     */
+    static unsigned NumReuseLookups() {
+        return blobs_.lookups() + contents_.lookups();
+    }
+
+    /** Number of files that reused an identical file instead of being tokenized.
+     */
+    static unsigned NumReused() {
+        return blobs_.hits() + contents_.hits();
+    }
+
+    /** Digest by which the file is checked for clones.
+     */
+    static Digest const & CloneDigest(TokenizedFile const * tf) {
+        return stopClones_ == StopClones::file ? tf->stats.fileHash() : tf->stats.tokensHash();
+    }
+
+    /** Loads the global tokens and their counts written by a previous run, keeping their ids.
+
+      The filename is given without extension, the text format is loaded if it exists, the binary format otherwise.
+     */
+    static void LoadGlobalTokens(std::string const & filename);
+
+    /** Restores a file written by a previous run. Originals are added to the clone index, clones need not be since their originals are there. New files and projects get larger ids than the restored ones.
+     */
+    static void RestoreFile(Digest const & digest, unsigned pid, unsigned fid, bool original);
 
     static unsigned NumClones() {
         return numClones_;
     }
 
     static unsigned NumUniqueTokens() {
-        //std::lock_guard<std::mutex> g(accessM_);
         return tokenIds_.size();
     }
 
@@ -87,23 +144,20 @@ private:
 
     CloneInfo checkClones(TokenizedFile * tf);
 
+    /** Returns the counts of all tokens, summed over all merger threads.
+     */
+    static std::vector<unsigned> globalTokenCounts();
+
     /** Changes the tokens in the file into global identifiers.
      */
     //void idsForTokens(TokenizedFile * tf);
 
-
-
-    void lockTokenIdRead();
-    void unlockTokenIdRead();
-    void lockTokenIdWrite();
-    void unlockTokenIdWrite();
-
-    void lockCounts();
-    void unlockCounts();
-
-
     void tokensToIds(TokenizedFile * tf);
 
+    /** Adds the token counts of a file that reused the token ids of an identical file.
+     */
+    void countIds(TokenizedFile * tf);
+
     void process(MergerJob const & job) override;
 
 
@@ -111,23 +165,37 @@ private:
     static unsigned pid_;
 
     static StopClones stopClones_;
-    static std::unordered_map<std::string, CloneInfo> clones_;
+    static CloneIndex clones_;
 
 
-    static std::unordered_map<std::string, unsigned> tokenIds_;
+    static TokenDictionary tokenIds_;
 
-    static std::vector<unsigned> tokenCounts_;
+    /** Interned files by the git blobs they were read from.
+     */
+    static SummaryCache<GitOid> blobs_;
 
+    /** Interned files by the hash of their contents, for files read from the working tree.
+     */
+    static SummaryCache<Digest> contents_;
 
-    //static std::unordered_map<std::string, TokenInfo> uniqueTokenIds_;
+    /** Token counts of all merger threads, summed only when the global tokens are written.
+     */
+    static std::vector<std::vector<unsigned> *> tokenCounts_;
 
+    /** Token counts loaded from a previous run.
+     */
+    static std::vector<unsigned> loadedCounts_;
 
-    /** Mutex guarding access to clone database.
+    /** Token counts for tokens seen by this merger thread, indexed by token id.
      */
-    static std::mutex accessC_;
+    std::vector<unsigned> counts_;
+
 
-    static std::mutex accessTid_;
+    //static std::unordered_map<std::string, TokenInfo> uniqueTokenIds_;
 
+
+    /** Mutex guarding registration of per thread token counts.
+     */
     static std::mutex accessTc_;
 
     /** Project id settings mutex guard */
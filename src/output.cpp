@@ -0,0 +1,163 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include <zlib.h>
+
+#include "utils.h"
+
+#include "output.h"
+
+OutputBuffer::~OutputBuffer() {
+    // destructors must not throw, the output is lost if the file cannot be written at this point
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void OutputBuffer::open(std::string const & filename, int compressionLevel, bool append) {
+    close();
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd_ < 0)
+        throw STR("Unable to open file " << filename << " for writing");
+    filename_ = filename;
+    flushed_ = 0;
+    memberStarted_ = false;
+    if (append and compressionLevel == 0) {
+        off_t size = lseek(fd_, 0, SEEK_END);
+        flushed_ = size < 0 ? 0 : size;
+    }
+    if (data_ == nullptr)
+        data_.reset(new char[capacity_]);
+    if (compressionLevel != 0) {
+        deflate_ = new z_stream();
+        // 16 added to the window bits selects the gzip format
+        if (deflateInit2(deflate_, compressionLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            delete deflate_;
+            deflate_ = nullptr;
+            throw STR("Unable to initialize compression of file " << filename);
+        }
+        if (compressed_ == nullptr)
+            compressed_.reset(new char[capacity_]);
+    }
+}
+
+void OutputBuffer::flush() {
+    write(data_.get(), size_);
+    flushed_ += size_;
+    size_ = 0;
+}
+
+void OutputBuffer::close() {
+    if (fd_ < 0)
+        return;
+    flush();
+    if (deflate_ != nullptr) {
+        // nothing may have been written since the last sync, but a file with no member at all still gets an empty one to be valid gzip
+        struct stat s;
+        if (memberStarted_ or fstat(fd_, & s) != 0 or s.st_size == 0)
+            deflate(nullptr, 0, true);
+        deflateEnd(deflate_);
+        delete deflate_;
+        deflate_ = nullptr;
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+uint64_t OutputBuffer::sync() {
+    flush();
+    if (deflate_ != nullptr and memberStarted_) {
+        deflate(nullptr, 0, true);
+        deflateReset(deflate_);
+        memberStarted_ = false;
+    }
+    if (fdatasync(fd_) != 0)
+        throw STR("Unable to sync file " << filename_);
+    struct stat s;
+    if (fstat(fd_, & s) != 0)
+        throw STR("Unable to sync file " << filename_);
+    return s.st_size;
+}
+
+void OutputBuffer::write(char const * what, size_t size) {
+    if (deflate_ != nullptr) {
+        // even an empty deflate emits the gzip header, which would start a new member after a sync
+        if (size > 0) {
+            deflate(what, size, false);
+            memberStarted_ = true;
+        }
+    } else {
+        writeAll(what, size);
+    }
+}
+
+void OutputBuffer::deflate(char const * what, size_t size, bool finish) {
+    deflate_->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(what));
+    deflate_->avail_in = size;
+    while (true) {
+        deflate_->next_out = reinterpret_cast<Bytef *>(compressed_.get());
+        deflate_->avail_out = capacity_;
+        int result = ::deflate(deflate_, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_ERROR)
+            throw STR("Unable to compress file " << filename_);
+        writeAll(compressed_.get(), capacity_ - deflate_->avail_out);
+        // without finishing, the compressor is done once it consumed all input and did not fill the output
+        if (finish ? result == Z_STREAM_END : (deflate_->avail_in == 0 and deflate_->avail_out != 0))
+            break;
+    }
+}
+
+void OutputBuffer::writeAll(char const * what, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd_, what, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw STR("Unable to write to file " << filename_);
+        }
+        what += written;
+        size -= written;
+    }
+}
+
+unsigned OutputBuffer::FormatDecimal(unsigned long long value, char * buffer) {
+    // two digits at a time, right to left into a scratch buffer
+    static char const digits[] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[20];
+    char * p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        unsigned i = (value % 100) * 2;
+        value /= 100;
+        *--p = digits[i + 1];
+        *--p = digits[i];
+    }
+    if (value >= 10) {
+        unsigned i = value * 2;
+        *--p = digits[i + 1];
+        *--p = digits[i];
+    } else {
+        *--p = '0' + value;
+    }
+    unsigned length = tmp + sizeof(tmp) - p;
+    memcpy(buffer, p, length);
+    return length;
+}
+
+unsigned OutputBuffer::FormatHex(uint32_t value, char * buffer) {
+    unsigned length = 1;
+    for (uint32_t x = value >> 4; x != 0; x >>= 4)
+        ++length;
+    for (unsigned i = length; i > 0; --i) {
+        buffer[i - 1] = toHexDigit(value & 0xf);
+        value >>= 4;
+    }
+    return length;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "hashes/hash.h"
+
+struct z_stream_s;
+
+/** Append only buffered output file.
+
+  Records are formatted straight into a large buffer, integers and digests by hand rather than through iostreams, and the buffer is written to the file in a single call whenever it fills up, or when flush() is called. Nothing is ever flushed per line.
+
+  The file may be gzip compressed, in which case the buffer is compressed each time it is flushed, by the thread flushing it. The compressed stream is only complete once the file is closed.
+
+  Errors when opening or writing the file are thrown.
+ */
+class OutputBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1024 * 1024;
+
+    /** The buffer is only allocated when the file is opened.
+     */
+    explicit OutputBuffer(size_t capacity = DEFAULT_CAPACITY):
+        fd_(-1),
+        deflate_(nullptr),
+        size_(0),
+        capacity_(capacity),
+        flushed_(0),
+        memberStarted_(false) {
+    }
+
+    OutputBuffer(OutputBuffer const &) = delete;
+    OutputBuffer & operator = (OutputBuffer const &) = delete;
+
+    /** Flushes and closes the file.
+     */
+    ~OutputBuffer();
+
+    /** Opens given file for writing, truncating it, or appending to it if append is true.
+
+      If the compression level is not 0, the output is gzip compressed with the given zlib level. Appending to a compressed file adds a new gzip member, which readers of the concatenated members see as a single stream.
+     */
+    void open(std::string const & filename, int compressionLevel = 0, bool append = false);
+
+    /** Writes the buffered contents to the file, compressing them first if the file is compressed.
+     */
+    void flush();
+
+    /** Flushes and closes the file.
+     */
+    void close();
+
+    /** Writes everything appended so far to the file and waits until it is on disk. Returns the size of the file.
+
+      A compressed file has its gzip member terminated, and the next flush starts a new one, so that the file can be truncated to the returned size and appended to later. If nothing was written since the last sync, no empty member is added.
+     */
+    uint64_t sync();
+
+    bool isOpen() const {
+        return fd_ >= 0;
+    }
+
+    std::string const & filename() const {
+        return filename_;
+    }
+
+    OutputBuffer & append(char const * what, size_t size) {
+        if (size_ + size > capacity_) {
+            flush();
+            // records larger than the buffer are written directly
+            if (size > capacity_) {
+                write(what, size);
+                flushed_ += size;
+                return *this;
+            }
+        }
+        memcpy(data_.get() + size_, what, size);
+        size_ += size;
+        return *this;
+    }
+
+    OutputBuffer & operator << (char c) {
+        if (size_ == capacity_)
+            flush();
+        data_[size_++] = c;
+        return *this;
+    }
+
+    OutputBuffer & operator << (char const * what) {
+        return append(what, strlen(what));
+    }
+
+    OutputBuffer & operator << (std::string const & what) {
+        return append(what.c_str(), what.size());
+    }
+
+    OutputBuffer & operator << (Digest const & d) {
+        char buffer[Digest::Bytes * 2];
+        d.writeHex(buffer);
+        return append(buffer, sizeof(buffer));
+    }
+
+    /** Integers are formatted in decimal.
+     */
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value, OutputBuffer &>::type operator << (T value) {
+        char buffer[24];
+        unsigned length;
+        if (std::is_signed<T>::value and value < 0) {
+            buffer[0] = '-';
+            length = FormatDecimal(0 - static_cast<unsigned long long>(value), buffer + 1) + 1;
+        } else {
+            length = FormatDecimal(static_cast<unsigned long long>(value), buffer);
+        }
+        return append(buffer, length);
+    }
+
+    /** Appends the number as a little endian base 128 varint.
+     */
+    OutputBuffer & appendVarint(uint64_t value) {
+        char buffer[10];
+        unsigned length = 0;
+        while (value >= 0x80) {
+            buffer[length++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        buffer[length++] = static_cast<char>(value);
+        return append(buffer, length);
+    }
+
+    /** Appends the number as 4 little endian bytes.
+     */
+    OutputBuffer & appendFixed32(uint32_t value) {
+        char buffer[4];
+        for (unsigned i = 0; i < 4; ++i)
+            buffer[i] = static_cast<char>(value >> (i * 8));
+        return append(buffer, 4);
+    }
+
+    /** Appends the number as 8 little endian bytes.
+     */
+    OutputBuffer & appendFixed64(uint64_t value) {
+        char buffer[8];
+        for (unsigned i = 0; i < 8; ++i)
+            buffer[i] = static_cast<char>(value >> (i * 8));
+        return append(buffer, 8);
+    }
+
+    /** Appends the 16 bytes of the digest.
+     */
+    OutputBuffer & appendDigest(Digest const & d) {
+        return append(reinterpret_cast<char const *>(d.bytes), Digest::Bytes);
+    }
+
+    /** Number of bytes appended since the file was opened, i.e. the offset in the uncompressed file at which the next byte will be written.
+     */
+    uint64_t offset() const {
+        return flushed_ + size_;
+    }
+
+    /** Sets the offset of the data already in the file.
+
+      When appending to an uncompressed file, the offset starts at the size of the file. The size of the uncompressed data in a compressed file is only known to the caller.
+     */
+    void setOffset(uint64_t offset) {
+        flushed_ = offset - size_;
+    }
+
+    /** Appends the number in lowercase hex.
+     */
+    OutputBuffer & appendHex(uint32_t value) {
+        char buffer[8];
+        return append(buffer, FormatHex(value, buffer));
+    }
+
+    /** Formats the number in decimal into given buffer, which must have room for at least 20 characters. Returns the number of characters written.
+     */
+    static unsigned FormatDecimal(unsigned long long value, char * buffer);
+
+    /** Formats the number in lowercase hex into given buffer, which must have room for at least 8 characters. Returns the number of characters written.
+     */
+    static unsigned FormatHex(uint32_t value, char * buffer);
+
+private:
+    /** Writes given data to the file, compressing them if the file is compressed.
+     */
+    void write(char const * what, size_t size);
+
+    /** Feeds the data to the compressor, writing any compressed output. If finish is true, the compressed stream is terminated.
+     */
+    void deflate(char const * what, size_t size, bool finish);
+
+    void writeAll(char const * what, size_t size);
+
+    int fd_;
+    z_stream_s * deflate_;
+    std::unique_ptr<char[]> compressed_;
+    std::string filename_;
+    std::unique_ptr<char[]> data_;
+    size_t size_;
+    size_t capacity_;
+    uint64_t flushed_;
+
+    /** True if data was compressed since the current gzip member started, i.e. the member is not empty.
+     */
+    bool memberStarted_;
+};
@@ -0,0 +1,56 @@
+#include <climits>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "parking.h"
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "Atomic state cannot hold the futex word");
+
+unsigned * Parking::epoch() {
+#if defined(__BYTE_ORDER__) and __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return reinterpret_cast<unsigned *>(& state_) + 1;
+#else
+    return reinterpret_cast<unsigned *>(& state_);
+#endif
+}
+
+void Parking::wait(unsigned epoch) {
+#ifdef __linux__
+    // returns immediately if the epoch has already changed, spurious wakeups are fine as the caller checks the condition again
+    syscall(SYS_futex, this->epoch(), FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+#else
+    while (Epoch(state_.load()) == epoch)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+    leave();
+}
+
+void Parking::leave() {
+    uint64_t state = state_.load();
+    while (not state_.compare_exchange_weak(state, state - WAITER - (Woken(state) > 0 ? WOKEN : 0))) {
+    }
+}
+
+void Parking::notify(int threads) {
+    // waiters which are not asleep yet return right away once the epoch changes, so a single wakeup reaches them all and one sleeping waiter
+    uint64_t state = state_.load();
+    while (true) {
+        unsigned waiters = Waiters(state);
+        unsigned woken = Woken(state);
+        if (waiters <= woken)
+            return;
+        uint64_t next = (state & ~uint64_t(0xffffffff)) + static_cast<uint32_t>(Epoch(state) + 1);
+        next += (threads < 0 ? waiters - woken : 1) * WOKEN;
+        if (state_.compare_exchange_weak(state, next))
+            break;
+    }
+#ifdef __linux__
+    syscall(SYS_futex, epoch(), FUTEX_WAKE_PRIVATE, threads < 0 ? INT_MAX : threads, nullptr, nullptr, 0);
+#endif
+}
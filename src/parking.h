@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/** Lets threads sleep until they are notified, without a mutex.
+
+  An event count: a thread that wants to wait for a condition first calls prepare(), then checks the condition once more and either cancels the wait, or waits with the epoch prepare() returned. Notifications change the epoch, so a notification that comes after prepare() is never lost. Notifying is a single atomic load when nobody waits.
+
+  Besides the epoch, the state counts the waiters and the wakeups already issued to them, all in a single word so that a wakeup is only issued together with the change of the epoch the waiters prepared with. A notification then only wakes waiters that are not being woken already. Otherwise, with more threads than cores, a woken waiter which did not run yet would make every notification a system call.
+
+  On Linux the threads sleep on a futex, elsewhere they poll.
+ */
+class Parking {
+public:
+    Parking():
+        state_(0) {
+    }
+
+    unsigned prepare() {
+        return Epoch(state_.fetch_add(WAITER));
+    }
+
+    void cancel() {
+        leave();
+    }
+
+    /** Sleeps unless there was a notification since the epoch was obtained by prepare().
+     */
+    void wait(unsigned epoch);
+
+    void notifyOne() {
+        uint64_t state = state_.load();
+        if (Waiters(state) > Woken(state))
+            notify(1);
+    }
+
+    void notifyAll() {
+        uint64_t state = state_.load();
+        if (Waiters(state) > Woken(state))
+            notify(-1);
+    }
+
+private:
+    /** The epoch is the low half of the state, the waiters and the issued wakeups share the high half.
+     */
+    static constexpr uint64_t WAITER = uint64_t(1) << 32;
+    static constexpr uint64_t WOKEN = uint64_t(1) << 48;
+
+    static unsigned Epoch(uint64_t state) {
+        return static_cast<uint32_t>(state);
+    }
+
+    static unsigned Waiters(uint64_t state) {
+        return (state >> 32) & 0xffff;
+    }
+
+    static unsigned Woken(uint64_t state) {
+        return state >> 48;
+    }
+
+    void notify(int threads);
+
+    /** Stops counting the calling thread as a waiter, taking one of the issued wakeups, if any.
+     */
+    void leave();
+
+    /** The epoch as the futex word.
+     */
+    unsigned * epoch();
+
+    std::atomic<uint64_t> state_;
+};
@@ -0,0 +1,270 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#include "git.h"
+#include "reader.h"
+#include "tokenizer.h"
+#include "merger.h"
+#include "manifest.h"
+
+unsigned Reader::batchSize_ = 64;
+bool Reader::useIoUring_ = true;
+std::string Reader::historyCache_;
+bool Reader::fromGit_ = false;
+
+namespace {
+
+    /** Releases the reader's handle to the project when the job ends, whether it succeeds or not, so that the project is freed once its files are written.
+     */
+    class ProjectHandle {
+    public:
+        ProjectHandle(GitProject * project):
+            project_(project) {
+        }
+
+        ~ProjectHandle() {
+            project_->release();
+        }
+
+    private:
+        GitProject * project_;
+    };
+
+}
+
+std::ostream & operator << (std::ostream & s, ReaderJob const & job) {
+    s << job.absPath();
+    return s;
+}
+
+Reader::Reader(unsigned index):
+    QueueProcessor<ReaderJob>(STR("READER " << index)),
+    // ring with no entries is invalid, in which case the files are read synchronously
+    uring_(useIoUring_ ? batchSize_ : 0) {
+}
+
+void Reader::initializeWorkers(unsigned num) {
+    for (unsigned i = 0; i < num; ++i) {
+        std::thread t([i] () {
+            Reader c(i);
+            c();
+        });
+        t.detach();
+    }
+}
+
+void Reader::process(ReaderJob const & job) {
+    ProjectHandle handle(job.project);
+    GitRepository repo(job.absPath());
+    GitOid head = repo.head();
+    // incremental runs skip projects which did not change since the previous run, and keep the ids of those that did
+    if (Manifest::Unchanged(job.absPath(), head)) {
+        ++Manifest::NumUnchangedProjects();
+        return;
+    }
+    job.project->id_ = Manifest::ProjectId(job.absPath());
+    std::vector<std::pair<unsigned, std::string>> files;
+    loadHistory(repo, head, job.absPath(), files);
+    if (fromGit_) {
+        readFromGit(repo, job, files);
+    } else {
+        try {
+            for (auto const & f : files) {
+                TokenizedFile * tf = new TokenizedFile(job.project, f.second);
+                tf->stats.createdDate = f.first;
+                batch_.push_back(tf);
+                if (batch_.size() >= batchSize_)
+                    readBatch();
+            }
+            readBatch();
+        } catch (...) {
+            // files of the failed batch were not handed over, deleting them releases their handles to the project
+            for (TokenizedFile * tf : batch_)
+                delete tf;
+            batch_.clear();
+            throw;
+        }
+    }
+    // project bookkeeping, so that floating projects are deleted when all their files are written and they are no longer needed, at which point their head is recorded, failed projects are not recorded and are read again by incremental runs
+    job.project->head_ = head;
+}
+
+void Reader::loadHistory(GitRepository & repo, GitOid const & head, std::string const & path, std::vector<std::pair<unsigned, std::string>> & files) {
+    std::string cache;
+    // deepening a shallow clone changes its history without moving HEAD, so the shallow commits are part of the key
+    std::string key = head.hex();
+    for (GitOid const & id : repo.shallow())
+        key += " " + id.hex();
+    if (not historyCache_.empty()) {
+        MD5 md5;
+        md5.add(path.c_str(), path.size());
+        cache = STR(historyCache_ << "/" << md5.getHash() << HISTORY_CACHE_EXT);
+        if (loadHistoryCache(cache, key, files))
+            return;
+    }
+    // TODO this should support multiple languages too
+    repo.forEachAddedFile([& files] (unsigned date, std::string const & file) {
+        if (isLanguageFile(file) and file.find('\n') == std::string::npos)
+            files.push_back(std::make_pair(date, file));
+    });
+    if (cache.empty())
+        return;
+    // write to a temporary file first so that concurrent or interrupted runs never see partial history
+    std::string tmp = STR(cache << "." << std::this_thread::get_id());
+    {
+        std::ofstream s(tmp);
+        s << key << "\n";
+        for (auto const & f : files)
+            s << f.first << " " << f.second << "\n";
+        if (not s.good())
+            throw STR("Unable to write history cache " << tmp);
+    }
+    if (rename(tmp.c_str(), cache.c_str()) != 0)
+        throw STR("Unable to write history cache " << cache);
+}
+
+void Reader::readFromGit(GitRepository & repo, ReaderJob const & job, std::vector<std::pair<unsigned, std::string>> const & files) {
+    // blobs of the files at HEAD, files deleted since they were added are skipped just like when reading the working tree
+    std::unordered_map<std::string, GitOid> blobs;
+    repo.forEachFile(repo.commitTree(repo.head()), [& blobs] (std::string const & path, GitRepository::TreeEntry const & e) {
+        if (e.isFile() and isLanguageFile(path))
+            blobs[path] = e.id;
+    });
+    std::string contents;
+    for (auto const & f : files) {
+        auto i = blobs.find(f.second);
+        if (i == blobs.end())
+            continue;
+        // owned until it is handed over, so that it releases its handle to the project if reading the blob throws
+        std::unique_ptr<TokenizedFile> tf(new TokenizedFile(job.project, f.second));
+        tf->stats.createdDate = f.first;
+        tf->blob = i->second;
+        ++processedFiles_;
+        // identical blobs, e.g. in forks, go straight to the merger
+        if (Merger::ReuseBlob(tf->blob, tf.get())) {
+            processedBytes_ += tf->stats.bytes();
+            if (Manifest::Unchanged(tf.get()))
+                continue;
+            Merger::ScheduleBuffered(MergerJob(tf.release()));
+            continue;
+        }
+        repo.read(tf->blob, GitRepository::Type::blob, contents);
+        processedBytes_ += contents.size();
+        tf->contents.assign(std::move(contents));
+        Tokenizer::ScheduleBuffered(TokenizerJob(tf.release()));
+    }
+}
+
+bool Reader::loadHistoryCache(std::string const & filename, std::string const & key, std::vector<std::pair<unsigned, std::string>> & files) {
+    std::ifstream s(filename);
+    std::string line;
+    if (not std::getline(s, line))
+        return false;
+    // history is stale if the project has moved on, or has been deepened, since it was cached
+    if (line != key)
+        return false;
+    while (std::getline(s, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos)
+            return false;
+        files.push_back(std::make_pair(std::atoi(line.c_str()), line.substr(space + 1)));
+    }
+    return true;
+}
+
+void Reader::readBatch() {
+    std::vector<int> fds(batch_.size(), -1);
+    std::vector<std::string> buffers(batch_.size());
+    try {
+        readFiles(fds, buffers);
+    } catch (...) {
+        // reads in flight write into the buffers, which must outlive them
+        uring_.cancel();
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+        throw;
+    }
+    // hand the files over to the tokenizers
+    for (TokenizedFile * tf : batch_) {
+        if (tf == nullptr)
+            continue;
+        processedBytes_ += tf->contents.size();
+        ++processedFiles_;
+        Tokenizer::ScheduleBuffered(TokenizerJob(tf));
+    }
+    batch_.clear();
+}
+
+void Reader::readFiles(std::vector<int> & fds, std::vector<std::string> & buffers) {
+    unsigned pending = 0;
+    // open the files, submit small files to the ring and load the rest directly
+    for (size_t i = 0, e = batch_.size(); i != e; ++i) {
+        TokenizedFile * tf = batch_[i];
+        int fd = openFile(tf);
+        if (fd < 0) {
+            delete tf;
+            batch_[i] = nullptr;
+            continue;
+        }
+        // descriptors still in fds are closed by readBatch() if reading throws
+        fds[i] = fd;
+        struct stat s;
+        size_t size = fstat(fd, &s) == 0 ? s.st_size : 0;
+        if (uring_.valid() and size > 0 and size < FileBuffer::MmapThreshold()) {
+            buffers[i].resize(size);
+            if (uring_.read(fd, & buffers[i][0], size, 0, i)) {
+                ++pending;
+                continue;
+            }
+        }
+        tf->contents.load(fd);
+        close(fd);
+        fds[i] = -1;
+    }
+    // wait for the submitted reads, short or failed reads are redone synchronously
+    if (pending > 0)
+        uring_.submit(pending);
+    while (pending > 0) {
+        uint64_t i;
+        int result;
+        if (not uring_.complete(i, result)) {
+            uring_.submit(1);
+            continue;
+        }
+        --pending;
+        if (result >= 0 and static_cast<size_t>(result) == buffers[i].size())
+            batch_[i]->contents.assign(std::move(buffers[i]));
+        else
+            batch_[i]->contents.load(fds[i]);
+        close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+int Reader::openFile(TokenizedFile * tf) {
+    std::string path = tf->absPath();
+    // files which were deleted since they were added
+    if (not isFile(path))
+        return -1;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Worker::Warning(STR("Resetting git for project " << tf->project()->path()));
+        if (system(STR("cd \"" << tf->project()->path() << "\" && git reset --hard").c_str()) != EXIT_SUCCESS) {
+            Worker::Error(STR("Unable to reset project " << tf->project()->path()));
+            error_ = true;
+            return -1;
+        }
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            Worker::Error(STR("Unable to open file " << path));
+            error_ = true;
+        }
+    }
+    return fd;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "data.h"
+#include "worker.h"
+#include "uring.h"
+#include "git.h"
+
+struct ReaderJob {
+    GitProject * project;
+
+    ReaderJob(std::string const & path, std::string const & url):
+        project(new GitProject(path, url)),
+        path_(path) {
+        ++project->handles_;
+    }
+
+    std::string const & absPath() const {
+        return path_;
+    }
+
+    /** Prettyprinting.
+     */
+    friend std::ostream & operator << (std::ostream & s, ReaderJob const & job);
+
+private:
+    /** Path of the project, kept by the job itself so that errors can be reported after the reader released the project.
+     */
+    std::string path_;
+};
+
+/** Reads the files of a project ahead of the tokenizers.
+
+  Files are read in batches. If io_uring is available, the whole batch is submitted at once so that the reads overlap, otherwise the reader threads simply read the files one by one. Either way the tokenizers get files that are already in memory and do not wait for I/O themselves.
+ */
+class Reader: public QueueProcessor<ReaderJob> {
+public:
+    Reader(unsigned index);
+
+    static void initializeWorkers(unsigned num);
+
+    /** Number of files read in a single batch.
+     */
+    static unsigned & BatchSize() {
+        return batchSize_;
+    }
+
+    /** If false, io_uring is not used even when available.
+     */
+    static bool & UseIoUring() {
+        return useIoUring_;
+    }
+
+    /** If true, the files are read from the git object store at HEAD instead of the working tree, which therefore need not be checked out.
+
+      Files whose blob has already been interned are not read at all, but reuse the interned blob.
+     */
+    static bool & FromGit() {
+        return fromGit_;
+    }
+
+    /** Directory where the file histories of projects are cached between runs. If empty, the histories are not cached.
+
+      The input projects are never written to.
+     */
+    static std::string & HistoryCache() {
+        return historyCache_;
+    }
+
+private:
+
+    /** Determines the files of the project and their creation dates and reads them in batches.
+     */
+    void process(ReaderJob const & job) override;
+
+    /** Walks the git history of the project and fills in the added language files and their author times, newest first.
+
+      If the history cache is enabled and holds the history for the current HEAD of the project, the history is loaded from the cache instead.
+     */
+    void loadHistory(GitRepository & repo, GitOid const & head, std::string const & path, std::vector<std::pair<unsigned, std::string>> & files);
+
+    /** Reads the files that still exist at HEAD from the object store and schedules them for tokenization.
+     */
+    void readFromGit(GitRepository & repo, ReaderJob const & job, std::vector<std::pair<unsigned, std::string>> const & files);
+
+    /** Loads the cached history. Returns false if there is none or if it was cached under a different key, i.e. for a different HEAD or different shallow commits.
+     */
+    bool loadHistoryCache(std::string const & filename, std::string const & key, std::vector<std::pair<unsigned, std::string>> & files);
+
+    /** Reads all files in the current batch and schedules them for tokenization.
+
+      If reading fails, the reads in flight are cancelled and the files stay in the batch.
+     */
+    void readBatch();
+
+    /** Reads the files of the current batch into their contents, through the ring where possible.
+
+      Descriptors of the files being read and the buffers of the reads in flight are kept in the given vectors, so that they can be cleaned up if reading throws.
+     */
+    void readFiles(std::vector<int> & fds, std::vector<std::string> & buffers);
+
+    /** Opens given file for reading.
+
+      Returns -1 if the file should be skipped.
+     */
+    int openFile(TokenizedFile * tf);
+
+    std::vector<TokenizedFile *> batch_;
+
+    Uring uring_;
+
+    static unsigned batchSize_;
+    static bool useIoUring_;
+    static std::string historyCache_;
+    static bool fromGit_;
+};
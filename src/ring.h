@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Bounded lock-free multiple producer multiple consumer queue.
+
+  Dmitry Vyukov's bounded MPMC queue. Each cell carries a sequence number that tells producers and consumers whether the cell is free for the given position, so that both sides only need a single compare and swap on their own position counter and never touch each other's cache lines unless the queue is (nearly) empty or full.
+
+  Capacity is rounded up to a power of two. push() and pop() fail immediately if the queue is full or empty, waiting is up to the caller.
+ */
+template<typename T>
+class Ring {
+public:
+    explicit Ring(size_t capacity):
+        cells_(nullptr),
+        mask_(0) {
+        reset(capacity);
+    }
+
+    ~Ring() {
+        clear();
+        delete [] cells_;
+    }
+
+    Ring(Ring const &) = delete;
+    Ring & operator = (Ring const &) = delete;
+
+    /** Changes the capacity of the queue, discarding its contents.
+
+      Must not run concurrently with any other method.
+     */
+    void reset(size_t capacity) {
+        clear();
+        delete [] cells_;
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        cells_ = new Cell[size];
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        enqueuePos_.store(0, std::memory_order_relaxed);
+        dequeuePos_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    /** Adds the value to the queue. Returns false if the queue is full.
+     */
+    bool push(T const & value) {
+        Cell * cell;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = & cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        new (& cell->storage) T(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Moves the oldest value of the queue to the end of given vector. Returns false if the queue is empty.
+     */
+    bool pop(std::vector<T> & into) {
+        Cell * cell;
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = & cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        T * value = reinterpret_cast<T *>(& cell->storage);
+        into.push_back(std::move(*value));
+        value->~T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Approximate number of values in the queue.
+     */
+    size_t size() const {
+        size_t e = enqueuePos_.load(std::memory_order_relaxed);
+        size_t d = dequeuePos_.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    /** Destroys values left in the queue. Must not run concurrently with any other method.
+     */
+    void clear() {
+        if (cells_ == nullptr)
+            return;
+        size_t e = enqueuePos_.load(std::memory_order_relaxed);
+        for (size_t pos = dequeuePos_.load(std::memory_order_relaxed); pos != e; ++pos)
+            reinterpret_cast<T *>(& cells_[pos & mask_].storage)->~T();
+        dequeuePos_.store(e, std::memory_order_relaxed);
+    }
+
+    Cell * cells_;
+    size_t mask_;
+
+    /** The positions are on separate cache lines so that producers and consumers do not invalidate each other's.
+     */
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+};
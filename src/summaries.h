@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include "data.h"
+
+/** Concurrent cache of interned files, keyed by the identity of their contents.
+
+  Files with identical contents have identical statistics and token ids, so once the merger has interned a file, its summary (see TokenizedFile::summary()) is stored under the key of its contents and later copies of the file reuse it instead of being tokenized again. The cache is split into shards by the key, each guarded by its own mutex, like the clone index.
+
+  Files are only looked up before they are tokenized, so a copy that is tokenized before the first copy is interned is simply tokenized again. Summaries are only added while the token ids of all summaries fit in the capacity, after which the cache only serves the summaries it already has. Summaries are never removed.
+ */
+template<typename KEY>
+class SummaryCache {
+public:
+    static constexpr unsigned NUM_SHARDS = 256;
+
+    /** Default capacity, in token ids of all summaries, roughly 512MB.
+     */
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+    SummaryCache():
+        capacity_(DEFAULT_CAPACITY),
+        used_(0),
+        size_(0),
+        lookups_(0),
+        hits_(0) {
+    }
+
+    SummaryCache(SummaryCache const &) = delete;
+    SummaryCache & operator = (SummaryCache const &) = delete;
+
+    ~SummaryCache() {
+        for (Shard & s : shards_)
+            for (auto & i : s.entries)
+                delete i.second;
+    }
+
+    /** If there is a summary for given key, makes the file reuse it and returns true.
+     */
+    bool reuse(KEY const & key, TokenizedFile * tf) {
+        ++lookups_;
+        Shard & s = shards_[std::hash<KEY>()(key) % NUM_SHARDS];
+        std::lock_guard<std::mutex> g(s.m);
+        auto i = s.entries.find(key);
+        if (i == s.entries.end())
+            return false;
+        tf->reuse(* i->second);
+        ++hits_;
+        return true;
+    }
+
+    /** Stores the summary of the interned file under given key, unless there already is one or the cache is full.
+     */
+    void insert(KEY const & key, TokenizedFile const * tf) {
+        size_t size = tf->ids.size() + 1;
+        if (used_ + size > capacity_)
+            return;
+        Shard & s = shards_[std::hash<KEY>()(key) % NUM_SHARDS];
+        {
+            std::lock_guard<std::mutex> g(s.m);
+            if (s.entries.find(key) != s.entries.end())
+                return;
+            s.entries[key] = tf->summary();
+        }
+        used_ += size;
+        ++size_;
+    }
+
+    /** Maximum number of token ids in all summaries.
+     */
+    void setCapacity(size_t capacity) {
+        capacity_ = capacity;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    /** Number of summaries in the cache.
+     */
+    unsigned size() const {
+        return size_;
+    }
+
+    /** Number of files looked up in the cache.
+     */
+    unsigned lookups() const {
+        return lookups_;
+    }
+
+    /** Number of files that reused a summary from the cache.
+     */
+    unsigned hits() const {
+        return hits_;
+    }
+
+private:
+    struct Shard {
+        std::mutex m;
+        std::unordered_map<KEY, TokenizedFile *> entries;
+    };
+
+    Shard shards_[NUM_SHARDS];
+
+    size_t capacity_;
+    std::atomic<size_t> used_;
+    std::atomic_uint size_;
+    std::atomic_uint lookups_;
+    std::atomic_uint hits_;
+};
@@ -3,20 +3,10 @@
 #include "worker.h"
 
 struct TokenizerJob {
-    GitProject * project;
-    std::string relPath;
+    TokenizedFile * file;
 
-    TokenizerJob(std::string const & path, std::string const & url):
-        project(new GitProject(path, url)),
-        relPath("") {
-        ++project->handles_;
-    }
-
-    std::string absPath() const {
-        if (relPath.empty())
-            return project->path();
-        else
-            return project->path() + "/" + relPath;
+    TokenizerJob(TokenizedFile * file):
+        file(file) {
     }
 
     /** Prettyprinting.
@@ -38,17 +28,10 @@ public:
 
 private:
 
-    /** Looks at all javascript files in the directory and tokenizes them.
-
-      Schedules any directories it finds recursively.
+    /** Tokenizes given file, whose contents have already been read, and schedules it for token identification and writing.
      */
     void process(TokenizerJob const & job) override;
 
-
-    /** Tokenizes given file and schedules it for token identification and writing.
-     */
-    void tokenize(GitProject * project, std::string const & relPath, int cdate);
-
     static std::atomic_uint jsErrors_;
 
 };
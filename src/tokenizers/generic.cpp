@@ -1,8 +1,24 @@
 #include "generic.h"
+#include "scan.h"
 #include "../worker.h"
 
-// "; . [ ] ( ) ~ ! - + & * / % < > & ^ | ? { } = # , " \ : $ '"
+namespace {
 
+    /** Characters that end a token, i.e. all characters handled by the switch in tokenize().
+
+      New lines must be part of all the sets so that top() sees them and normalizes the line endings exactly as if the file was processed character by character.
+     */
+    ByteSet const separators = { ';', '.', '[', ']', '(', ')', '~', '!', '-', '+', '&', '*', '/', '%', '<', '>', '^', '|', '?', '{', '}', '=', '#', ',', '"', '\\', ':', '$', '\'', '\t', ' ', '\r', '\n' };
+
+    /** Characters that may end a single line comment.
+     */
+    ByteSet const lineCommentStops = { '\r', '\n' };
+
+    /** Characters that may end a multi-line comment.
+     */
+    ByteSet const commentStops = { '*', '\r', '\n' };
+
+}
 
 bool GenericTokenizer::eof() {
     return pos_ >= data_.size();
@@ -39,7 +55,7 @@ char GenericTokenizer::peek(int offset) {
 void GenericTokenizer::addToken(unsigned start, unsigned length) {
     if (length > 0) {
         hasToken_ = true;
-        f_.addToken(data_.substr(start, length));
+        f_.addToken(TokenView(data_.data() + start, length));
         f_.stats.tokenBytes_ += length;
     }
 }
@@ -63,19 +79,30 @@ void GenericTokenizer::tokenize() {
     unsigned start = 0;
     unsigned tokenLength_ = 0;
     while (not eof()) {
+        // skip the token characters at once, none of them is special
+        unsigned next = separators.find(data_.data(), pos_, data_.size());
+        tokenLength_ += next - pos_;
+        pos_ = next;
+        if (eof())
+            break;
         if (top() == '/') {
             // single line comment
             if (peek(1) == '/') {
                 pop(2);
                 hasComment_ = true;
-                while (not eof() and top() != '\n')
+                while (true) {
+                    pos_ = lineCommentStops.find(data_.data(), pos_, data_.size());
+                    if (eof() or top() == '\n')
+                        break;
                     pop();
+                }
             // multi-line comment
             } else if (peek(1) == '*') {
                 pop(2);
                 hasComment_ = true;
-                while (not eof()) {
-                    if (top() == '*' and peek(1) == '/')
+                while (true) {
+                    pos_ = commentStops.find(data_.data(), pos_, data_.size());
+                    if (eof() or (top() == '*' and peek(1) == '/'))
                         break;
                     pop();
                 }
@@ -134,21 +161,7 @@ void GenericTokenizer::tokenize() {
     addToken(start, tokenLength_);
 }
 
-void GenericTokenizer::loadEntireFile() {
-    std::ifstream s(f_.absPath(), std::ios::in | std::ios::binary);
-    if (not s.good()) {
-        Worker::Warning(STR("Resetting git for project " << f_.project()->path()));
-        if (system(STR("cd \"" << f_.project()->path() << "\" && git reset --hard").c_str()) != EXIT_SUCCESS)
-            throw STR("Unable to reset project " << f_.project()->path());
-        s.open(f_.absPath(), std::ios::in | std::ios::binary);
-        if (not s.good())
-            throw STR("Unable to open file " << f_.absPath());
-    }
-    s.seekg(0, std::ios::end);
-    data_.resize(s.tellg());
-    s.seekg(0, std::ios::beg);
-    s.read(& data_[0], data_.size());
-    s.close();
+void GenericTokenizer::checkContents() {
     if (data_.size() >= 4 and data_[0] == 'P' and data_[1] =='K' and data_[2] == '\003' and data_[3] == '\004')
         throw STR("File " << f_.absPath() << " seems to be archive");
 }
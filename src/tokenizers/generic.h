@@ -12,7 +12,7 @@ class GenericTokenizer {
 public:
     static void tokenize(TokenizedFile * f) {
         GenericTokenizer t(f);
-        t.loadEntireFile();
+        t.checkContents();
         t.tokenize();
         f->updateFileStats(t.data_);
     }
@@ -20,7 +20,8 @@ public:
 private:
 
     GenericTokenizer(TokenizedFile * f):
-        f_(*f) {
+        f_(*f),
+        data_(f->contents) {
     }
 
     bool eof();
@@ -36,13 +37,15 @@ private:
 
 
 
-    void loadEntireFile();
+    /** Checks that the already loaded contents of the file look like text.
+     */
+    void checkContents();
 
 
 
 
     TokenizedFile & f_;
-    std::string data_;
+    FileBuffer & data_;
 
     unsigned pos_;
     bool hasComment_;
@@ -1,4 +1,5 @@
-#include <fstream>
+#include <cassert>
+#include <cstring>
 
 #include "js.h"
 
@@ -6,84 +7,124 @@
 
 namespace {
 
-    std::unordered_set<std::string> initializeJSKeywords() {
-        std::unordered_set<std::string> result;
-        result.insert("abstract");
-        result.insert("arguments");
-        result.insert("boolean");
-        result.insert("break");
-        result.insert("byte");
-        result.insert("case");
-        result.insert("catch");
-        result.insert("char");
-        result.insert("class");
-        result.insert("const");
-        result.insert("continue");
-        result.insert("debugger");
-        result.insert("default");
-        result.insert("delete");
-        result.insert("do");
-        result.insert("double");
-        result.insert("else");
-        result.insert("enum");
-        result.insert("evail");
-        result.insert("export");
-        result.insert("extends");
-        result.insert("false");
-        result.insert("final");
-        result.insert("finally");
-        result.insert("float");
-        result.insert("for");
-        result.insert("function");
-        result.insert("goto");
-        result.insert("if");
-        result.insert("implements");
-        result.insert("import");
-        result.insert("in");
-        result.insert("instanceof");
-        result.insert("int");
-        result.insert("interface");
-        result.insert("let");
-        result.insert("long");
-        result.insert("native");
-        result.insert("new");
-        result.insert("null");
-        result.insert("package");
-        result.insert("private");
-        result.insert("protected");
-        result.insert("public");
-        result.insert("return");
-        result.insert("short");
-        result.insert("static");
-        result.insert("super");
-        result.insert("switch");
-        result.insert("synchronized");
-        result.insert("this");
-        result.insert("throw");
-        result.insert("throws");
-        result.insert("transient");
-        result.insert("true");
-        result.insert("try");
-        result.insert("typeof");
-        result.insert("var");
-        result.insert("void");
-        result.insert("volatile");
-        result.insert("while");
-        result.insert("with");
-        result.insert("yield");
-        return result;
+    char const * const jsKeywords[] = {
+        "abstract",
+        "arguments",
+        "boolean",
+        "break",
+        "byte",
+        "case",
+        "catch",
+        "char",
+        "class",
+        "const",
+        "continue",
+        "debugger",
+        "default",
+        "delete",
+        "do",
+        "double",
+        "else",
+        "enum",
+        "evail",
+        "export",
+        "extends",
+        "false",
+        "final",
+        "finally",
+        "float",
+        "for",
+        "function",
+        "goto",
+        "if",
+        "implements",
+        "import",
+        "in",
+        "instanceof",
+        "int",
+        "interface",
+        "let",
+        "long",
+        "native",
+        "new",
+        "null",
+        "package",
+        "private",
+        "protected",
+        "public",
+        "return",
+        "short",
+        "static",
+        "super",
+        "switch",
+        "synchronized",
+        "this",
+        "throw",
+        "throws",
+        "transient",
+        "true",
+        "try",
+        "typeof",
+        "var",
+        "void",
+        "volatile",
+        "while",
+        "with",
+        "yield",
+    };
+
+    /** Hash of a keyword candidate, perfect on the keywords above.
+
+      The constants were found by search so that no two keywords collide in the 256 slots of KeywordTable. The size must be at least 2.
+     */
+    constexpr unsigned keywordHash(char const * s, unsigned size) {
+        return (static_cast<unsigned char>(s[0]) * 49 + static_cast<unsigned char>(s[1]) + static_cast<unsigned char>(s[size - 1]) + size * 9) & 0xff;
     }
+
+    /** Perfect hash table of the JS keywords.
+
+      Each slot holds the index of the keyword hashed to it plus one, or 0 if empty, so that recognizing a keyword takes a single hash of the view and at most one comparison, without building any string.
+     */
+    class KeywordTable {
+    public:
+        KeywordTable() {
+            memset(slots_, 0, sizeof(slots_));
+            for (unsigned i = 0; i < sizeof(jsKeywords) / sizeof(jsKeywords[0]); ++i) {
+                unsigned h = keywordHash(jsKeywords[i], strlen(jsKeywords[i]));
+                assert(slots_[h] == 0 and "Keyword hash is not perfect");
+                slots_[h] = i + 1;
+            }
+        }
+
+        bool contains(TokenView const & s) const {
+            if (s.size < 2)
+                return false;
+            unsigned i = slots_[keywordHash(s.data, s.size)];
+            if (i == 0)
+                return false;
+            char const * k = jsKeywords[i - 1];
+            return strncmp(k, s.data, s.size) == 0 and k[s.size] == 0;
+        }
+
+    private:
+        uint8_t slots_[256];
+    };
+
+    KeywordTable const keywords;
 }
 
-std::unordered_set<std::string> JSTokenizer::jsKeywords_ = initializeJSKeywords();
+ByteSet const JSTokenizer::identifierEnds_ = { '\n', '\r', ' ', '\t', '"', '\'', '`', '/', '>', '<', '=', '!', '+', '-', '*', '%', '&', '|', '^', '}', ')', ']', '{', '(', '[', '.', ',', ';', ':', '~', '?', 0 };
+ByteSet const JSTokenizer::blanks_ = { ' ', '\t', '\r' };
+ByteSet const JSTokenizer::lineCommentEnds_ = { '\n' };
+ByteSet const JSTokenizer::commentStops_ = { '*', '\n' };
 
 bool JSTokenizer::ignoreComments_ = true;
 bool JSTokenizer::ignoreSeparators_ = true;
 bool JSTokenizer::ignoreWhitespace_ = true;
 
 
-bool JSTokenizer::isKeyword(std::string const &s) {
-    return jsKeywords_.find(s) != jsKeywords_.end();
+bool JSTokenizer::isKeyword(TokenView const & s) {
+    return keywords.contains(s);
 }
 
 
@@ -115,21 +156,18 @@ char JSTokenizer::peek(int offset) {
     return data_[pos_ + offset];
 }
 
-std::string JSTokenizer::substr(size_t start, size_t end) {
-    try {
-        return data_.substr(start, end - start);
-    } catch (...) {
+TokenView JSTokenizer::token(size_t start, size_t end) {
+    if (start > data_.size()) {
         std::cout << "HERE I FAIL: " << f_.absPath() << std::endl;
         std::cout << "ouch" << std::endl;
-        //exit(-1);
-        //system(STR("mv " << f_.absPath() << " " << "/home/peta/sourcerer/data/errors").c_str());
         throw "continuing";
-
     }
-    return "";
+    if (end > data_.size())
+        end = data_.size();
+    return TokenView(data_.data() + start, end - start);
 }
 
-void JSTokenizer::addToken(std::string const & s) {
+void JSTokenizer::addToken(TokenView const & s) {
 /*    if (s.size() > 1000) {
         std::cout << "Token: " << s << std::endl;
         std::cout << f_.absPath() << std::endl;
@@ -140,30 +178,30 @@ void JSTokenizer::addToken(std::string const & s) {
 }
 
 void JSTokenizer::addToken(size_t start) {
-    addToken(substr(start, pos()));
+    addToken(token(start, pos()));
 }
 
 void JSTokenizer::addSeparator(size_t start) {
-    //std::cout << "Separator: " << substr(start, pos()) << std::endl;
+    //std::cout << "Separator: " << token(start, pos()) << std::endl;
     f_.addSeparator(pos_ - start);
     commentLine_ = false;
     if (not ignoreSeparators_)
-        f_.addToken(substr(start, pos()));
+        f_.addToken(token(start, pos()));
 }
 
 void JSTokenizer::addComment(size_t start) {
-    //std::cout << "Comment: " << substr(start, pos()) << std::endl;
+    //std::cout << "Comment: " << token(start, pos()) << std::endl;
     f_.addComment(pos_ - start);
     emptyLine_ = false;
     if (not ignoreComments_)
-        f_.addToken(substr(start, pos()));
+        f_.addToken(token(start, pos()));
 }
 
 void JSTokenizer::addWhitespace(size_t start) {
-    //std::cout << "Whitespace: " << substr(start, pos()) << std::endl;
+    //std::cout << "Whitespace: " << token(start, pos()) << std::endl;
     f_.addWhitespace(pos_ - start);
     if (not ignoreWhitespace_)
-        f_.addToken(substr(start, pos()));
+        f_.addToken(token(start, pos()));
 }
 
 
@@ -309,18 +347,16 @@ void JSTokenizer::regularExpressionLiteral() {
         f_.tokenizationError();
     }
     // now parse the flags, as if identifier
-    while (isIdentifier(top()))
-        pop(1);
+    pos_ = identifierEnds_.find(data_.data(), pos_, size());
     addToken(start);
 }
 
 
 bool JSTokenizer::identifierOrKeyword() {
     unsigned start = pos();
-    while (isIdentifier(top()))
-        pop(1);
-    std::string s = substr(start, pos());
-    if (not s.empty())
+    pos_ = identifierEnds_.find(data_.data(), pos_, size());
+    TokenView s = token(start, pos());
+    if (s.size != 0)
         addToken(s);
     return isKeyword(s);
 }
@@ -329,8 +365,7 @@ void JSTokenizer::singleLineComment() {
     unsigned start = pos();
     emptyLine_ = false; // the line definitely contains at least the comment
     pop(2); // //
-    while (not eof() and top() != '\n')
-        pop(1);
+    pos_ = lineCommentEnds_.find(data_.data(), pos_, size());
     newline();
     if (not eof())
         pop(1);
@@ -341,7 +376,10 @@ void JSTokenizer::multiLineComment() {
     unsigned start = pos();
     emptyLine_ = false; // the line definitely contains at least the comment
     pop(2); // /*
-    while (not eof()) {
+    while (true) {
+        pos_ = commentStops_.find(data_.data(), pos_, size());
+        if (eof())
+            break;
         if (top() == '*' and peek(1) == '/') {
             pop(2);
             break;
@@ -371,7 +409,7 @@ void JSTokenizer::tokenize() {
             Worker::Log(STR("Unknown character " << top()));
             f_.tokenizationError();
             pop(1);
-            addToken(substr(start, pos()));
+            addToken(start);
         }
         start = pos();
         switch (top()) {
@@ -381,6 +419,9 @@ void JSTokenizer::tokenize() {
             case '\t':
             case '\r':
                 pop(1);
+                // whitespace is reported per character when it becomes tokens
+                if (ignoreWhitespace_)
+                    pos_ = blanks_.skip(data_.data(), pos_, size());
                 addWhitespace(start);
                 continue; // do not change regexp expectations
             case '0':
@@ -642,7 +683,7 @@ void JSTokenizer::convertUTF16be() {
         }
         encodeUTF8(cp, result);
     }
-    data_ = std::move(result);
+    data_.assign(std::move(result));
 }
 
 
@@ -665,24 +706,10 @@ void JSTokenizer::convertUTF16le() {
         }
         encodeUTF8(cp, result);
     }
-    data_ = std::move(result);
+    data_.assign(std::move(result));
 }
 
-void JSTokenizer::loadEntireFile() {
-    std::ifstream s(f_.absPath(), std::ios::in | std::ios::binary);
-    if (not s.good()) {
-        Worker::Warning(STR("Resetting git for project " << f_.project()->path()));
-        if (system(STR("cd \"" << f_.project()->path() << "\" && git reset --hard").c_str()) != EXIT_SUCCESS)
-            throw STR("Unable to reset project " << f_.project()->path());
-        s.open(f_.absPath(), std::ios::in | std::ios::binary);
-        if (not s.good())
-            throw STR("Unable to open file " << f_.absPath());
-    }
-    s.seekg(0, std::ios::end);
-    data_.resize(s.tellg());
-    s.seekg(0, std::ios::beg);
-    s.read(& data_[0], data_.size());
-    s.close();
+void JSTokenizer::checkContents() {
     pos_ = 0;
     // check the encoding BOMs
     if (data_.size() >= 2) {
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <unordered_set>
-
 #include "../data.h"
+#include "scan.h"
 
 
 
@@ -12,14 +11,14 @@ class JSTokenizer {
 public:
     static void tokenize(TokenizedFile * f) {
         JSTokenizer t(f);
-        t.loadEntireFile();
+        t.checkContents();
         t.tokenize();
         f->updateFileStats(t.data_);
     }
 
-    static void Tokenize(TokenizedFile & f, std::string const & contents) {
+    static void Tokenize(TokenizedFile & f, FileBuffer const & contents) {
         JSTokenizer t(&f);
-        t.data_ = contents;
+        f.contents.assign(std::string(contents.data(), contents.size()));
         t.pos_ = 0;
         t.tokenize();
         f.updateFileStats(t.data_);
@@ -41,6 +40,7 @@ public:
 private:
 
     JSTokenizer(TokenizedFile * f):
+        data_(f->contents),
         f_(*f) {
     }
 
@@ -61,48 +61,14 @@ private:
     }
 
     /** This works the other way around. Thanks to UTF anything is an identifier, unless it is one of the separators.
+
+      Looked up in a 256 entry table, as it is called for every character of every identifier.
      */
     static bool isIdentifier(char c) {
-       switch (c) {
-           case '\n':
-           case '\r':
-           case ' ':
-           case '\t':
-           case '"':
-           case '\'':
-           case '`':
-           case '/':
-           case '>':
-           case '<':
-           case '=':
-           case '!':
-           case '+':
-           case '-':
-           case '*':
-           case '%':
-           case '&':
-           case '|':
-           case '^':
-           case '}':
-           case ')':
-           case ']':
-           case '{':
-           case '(':
-           case '[':
-           case '.':
-           case ',':
-           case ';':
-           case ':':
-           case '~':
-           case '?':
-           case 0: // for end of file termination
-               return false;
-           default:
-               return true;
-       }
+        return not identifierEnds_.contains(c);
     }
 
-    bool isKeyword(std::string const & s);
+    bool isKeyword(TokenView const & s);
 
     size_t size();
 
@@ -116,13 +82,15 @@ private:
 
     char peek(int offset);
 
-    std::string substr(size_t start, size_t end);
+    /** Returns the token between given positions as a view into the file contents.
+     */
+    TokenView token(size_t start, size_t end);
 
     void updateFileHash();
 
 
 
-    void addToken(std::string const & s);
+    void addToken(TokenView const & s);
     void addToken(size_t start);
     void addSeparator(size_t start);
     void addComment(size_t start);
@@ -168,9 +136,11 @@ private:
     void convertUTF16le();
     void convertUTF16be();
 
-    void loadEntireFile();
+    /** Converts the already loaded contents of the file from UTF16 if required and checks that they look like text.
+     */
+    void checkContents();
 
-    std::string data_;
+    FileBuffer & data_;
     unsigned pos_;
 
     TokenizedFile & f_;
@@ -180,7 +150,16 @@ private:
 
 
 
-    static std::unordered_set<std::string> jsKeywords_;
+    /** Characters that are not part of identifiers, including 0 for end of file termination.
+     */
+    static ByteSet const identifierEnds_;
+
+    /** Whitespace that does not end a line, skipped at once when whitespace is ignored.
+     */
+    static ByteSet const blanks_;
+
+    static ByteSet const lineCommentEnds_;
+    static ByteSet const commentStops_;
 
     static bool ignoreComments_;
     static bool ignoreSeparators_;
@@ -0,0 +1,144 @@
+#include <cstring>
+
+#include "scan.h"
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define HAS_X86_SIMD
+#endif
+
+namespace {
+
+    ByteSet::Level detectInstructionSet() {
+#ifdef HAS_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return ByteSet::Level::avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return ByteSet::Level::ssse3;
+#endif
+        return ByteSet::Level::scalar;
+    }
+
+#ifdef HAS_X86_SIMD
+
+    /** Returns position of the first byte in (or not in if INVERT) the set, or the position from which less than 32 bytes remain.
+     */
+    template<bool INVERT>
+    __attribute__((target("avx2")))
+    size_t findAVX2(uint8_t const * lo, uint8_t const * hi, char const * data, size_t from, size_t size) {
+        __m256i loTable = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(lo)));
+        __m256i hiTable = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(hi)));
+        __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i zero = _mm256_setzero_si256();
+        while (from + 32 <= size) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + from));
+            __m256i l = _mm256_shuffle_epi8(loTable, _mm256_and_si256(x, nibble));
+            __m256i h = _mm256_shuffle_epi8(hiTable, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+            // bits are set for bytes outside the set
+            uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero));
+            if (not INVERT)
+                mask = ~mask;
+            if (mask != 0)
+                return from + __builtin_ctz(mask);
+            from += 32;
+        }
+        return from;
+    }
+
+    /** Returns position of the first byte in (or not in if INVERT) the set, or the position from which less than 16 bytes remain.
+     */
+    template<bool INVERT>
+    __attribute__((target("ssse3")))
+    size_t findSSSE3(uint8_t const * lo, uint8_t const * hi, char const * data, size_t from, size_t size) {
+        __m128i loTable = _mm_load_si128(reinterpret_cast<__m128i const *>(lo));
+        __m128i hiTable = _mm_load_si128(reinterpret_cast<__m128i const *>(hi));
+        __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i zero = _mm_setzero_si128();
+        while (from + 16 <= size) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + from));
+            __m128i l = _mm_shuffle_epi8(loTable, _mm_and_si128(x, nibble));
+            __m128i h = _mm_shuffle_epi8(hiTable, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+            // bits are set for bytes outside the set
+            uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero));
+            if (not INVERT)
+                mask = ~mask & 0xffff;
+            else
+                mask &= 0xffff;
+            if (mask != 0)
+                return from + __builtin_ctz(mask);
+            from += 16;
+        }
+        return from;
+    }
+
+#endif
+
+}
+
+ByteSet::Level ByteSet::level_ = detectInstructionSet();
+
+ByteSet::ByteSet(std::initializer_list<char> bytes):
+    simd_(true) {
+    memset(table_, 0, sizeof(table_));
+    memset(lo_, 0, sizeof(lo_));
+    memset(hi_, 0, sizeof(hi_));
+    // low nibbles present for each high nibble
+    uint16_t lows[16] = { 0 };
+    for (char c : bytes) {
+        unsigned char x = static_cast<unsigned char>(c);
+        table_[x] = true;
+        lows[x >> 4] |= 1 << (x & 0x0f);
+    }
+    // high nibbles with the same low nibbles form a group with its own bit
+    uint16_t groups[8];
+    unsigned numGroups = 0;
+    for (unsigned h = 0; h < 16; ++h) {
+        if (lows[h] == 0)
+            continue;
+        unsigned g = 0;
+        while (g < numGroups and groups[g] != lows[h])
+            ++g;
+        if (g == numGroups) {
+            // too many groups for the lookup tables, only the scalar search can be used
+            if (numGroups == 8) {
+                simd_ = false;
+                return;
+            }
+            groups[numGroups++] = lows[h];
+        }
+        hi_[h] |= 1 << g;
+    }
+    for (unsigned g = 0; g < numGroups; ++g)
+        for (unsigned l = 0; l < 16; ++l)
+            if (groups[g] & (1 << l))
+                lo_[l] |= 1 << g;
+}
+
+size_t ByteSet::find(char const * data, size_t from, size_t size) const {
+#ifdef HAS_X86_SIMD
+    if (simd_) {
+        if (level_ == Level::avx2)
+            from = findAVX2<false>(lo_, hi_, data, from, size);
+        else if (level_ == Level::ssse3)
+            from = findSSSE3<false>(lo_, hi_, data, from, size);
+    }
+#endif
+    while (from < size and not contains(data[from]))
+        ++from;
+    return from;
+}
+
+size_t ByteSet::skip(char const * data, size_t from, size_t size) const {
+#ifdef HAS_X86_SIMD
+    if (simd_) {
+        if (level_ == Level::avx2)
+            from = findAVX2<true>(lo_, hi_, data, from, size);
+        else if (level_ == Level::ssse3)
+            from = findSSSE3<true>(lo_, hi_, data, from, size);
+    }
+#endif
+    while (from < size and contains(data[from]))
+        ++from;
+    return from;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+/** Set of bytes that can be searched for in a buffer.
+
+  The search classifies 32 (AVX2) or 16 (SSSE3) bytes at once using two nibble lookup tables, the implementation is chosen at runtime depending on the cpu, with a table driven scalar fallback. All implementations return identical results.
+
+  The high nibbles of the bytes in the set are grouped by the low nibbles they are combined with, each group gets one bit in the lookup tables. Sets with more than 8 such groups are searched by the scalar code only.
+ */
+class ByteSet {
+public:
+    enum class Level {
+        scalar,
+        ssse3,
+        avx2,
+    };
+
+    ByteSet(std::initializer_list<char> bytes);
+
+    bool contains(char c) const {
+        return table_[static_cast<unsigned char>(c)];
+    }
+
+    /** Returns position of the first byte from the set in data between from and size, or size if there is none.
+     */
+    size_t find(char const * data, size_t from, size_t size) const;
+
+    /** Returns position of the first byte not in the set in data between from and size, or size if there is none.
+     */
+    size_t skip(char const * data, size_t from, size_t size) const;
+
+    /** Instruction set used for the searches.
+
+      Initialized to the best one supported by the cpu, can be lowered for testing and benchmarking.
+     */
+    static Level & InstructionSet() {
+        return level_;
+    }
+
+private:
+    bool table_[256];
+    bool simd_;
+
+    alignas(16) uint8_t lo_[16];
+    alignas(16) uint8_t hi_[16];
+
+    static Level level_;
+};
@@ -0,0 +1,191 @@
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "utils.h"
+#include "uring.h"
+
+#if defined(__linux__) and defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAS_IO_URING
+#endif
+#endif
+
+#ifdef HAS_IO_URING
+
+namespace {
+
+    void * offset(void * base, unsigned off) {
+        return static_cast<char *>(base) + off;
+    }
+
+}
+
+Uring::Uring(unsigned entries):
+    fd_(-1),
+    entries_(0),
+    queued_(0),
+    inFlight_(0),
+    sqRing_(MAP_FAILED),
+    cqRing_(MAP_FAILED),
+    sqes_(MAP_FAILED) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return;
+    // iovecs must not be required to outlive the submission
+    if (not (p.features & IORING_FEAT_SUBMIT_STABLE)) {
+        close(fd);
+        return;
+    }
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        if (cqRingSize_ > sqRingSize_)
+            sqRingSize_ = cqRingSize_;
+        cqRingSize_ = 0;
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    if (single) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            munmap(sqRing_, sqRingSize_);
+            close(fd);
+            return;
+        }
+    }
+    sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        if (not single)
+            munmap(cqRing_, cqRingSize_);
+        munmap(sqRing_, sqRingSize_);
+        close(fd);
+        return;
+    }
+    sqHead_ = static_cast<unsigned *>(offset(sqRing_, p.sq_off.head));
+    sqTail_ = static_cast<unsigned *>(offset(sqRing_, p.sq_off.tail));
+    sqMask_ = static_cast<unsigned *>(offset(sqRing_, p.sq_off.ring_mask));
+    sqArray_ = static_cast<unsigned *>(offset(sqRing_, p.sq_off.array));
+    cqHead_ = static_cast<unsigned *>(offset(cqRing_, p.cq_off.head));
+    cqTail_ = static_cast<unsigned *>(offset(cqRing_, p.cq_off.tail));
+    cqMask_ = static_cast<unsigned *>(offset(cqRing_, p.cq_off.ring_mask));
+    cqes_ = offset(cqRing_, p.cq_off.cqes);
+    entries_ = p.sq_entries;
+    iovecs_.resize(entries_);
+    fd_ = fd;
+}
+
+Uring::~Uring() {
+    if (fd_ < 0)
+        return;
+    munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_)
+        munmap(cqRing_, cqRingSize_);
+    munmap(sqRing_, sqRingSize_);
+    close(fd_);
+}
+
+bool Uring::read(int fd, char * buffer, size_t size, uint64_t offset, uint64_t tag) {
+    unsigned tail = *sqTail_;
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= entries_)
+        return false;
+    unsigned index = tail & *sqMask_;
+    iovecs_[index].iov_base = buffer;
+    iovecs_[index].iov_len = size;
+    struct io_uring_sqe * sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(& iovecs_[index]);
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+    return true;
+}
+
+void Uring::submit(unsigned waitFor) {
+    while (true) {
+        int r = syscall(__NR_io_uring_enter, fd_, queued_, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (r >= 0) {
+            queued_ -= r;
+            inFlight_ += r;
+            // if the kernel did not take everything, resubmit the rest, but do not wait again for completions already accounted for
+            if (queued_ == 0)
+                return;
+            waitFor = 0;
+        } else if (errno != EINTR and errno != EAGAIN and errno != EBUSY) {
+            throw STR("io_uring_enter failed: " << strerror(errno));
+        }
+    }
+}
+
+bool Uring::complete(uint64_t & tag, int & result) {
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+        return false;
+    struct io_uring_cqe * cqe = static_cast<struct io_uring_cqe *>(cqes_) + (head & *cqMask_);
+    tag = cqe->user_data;
+    result = cqe->res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    --inFlight_;
+    return true;
+}
+
+void Uring::cancel() {
+    // the kernel only looks at the submission queue when entered, so reads not submitted yet can be taken back
+    __atomic_store_n(sqTail_, *sqTail_ - queued_, __ATOMIC_RELEASE);
+    queued_ = 0;
+    while (inFlight_ > 0) {
+        uint64_t tag;
+        int result;
+        if (complete(tag, result))
+            continue;
+        int r = syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (r < 0 and errno != EINTR and errno != EAGAIN and errno != EBUSY)
+            throw STR("io_uring_enter failed: " << strerror(errno));
+    }
+}
+
+#else
+
+Uring::Uring(unsigned entries):
+    fd_(-1),
+    entries_(0),
+    queued_(0),
+    inFlight_(0) {
+}
+
+Uring::~Uring() {
+}
+
+bool Uring::read(int fd, char * buffer, size_t size, uint64_t offset, uint64_t tag) {
+    return false;
+}
+
+void Uring::submit(unsigned waitFor) {
+}
+
+bool Uring::complete(uint64_t & tag, int & result) {
+    return false;
+}
+
+void Uring::cancel() {
+}
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/uio.h>
+
+/** Minimal io_uring wrapper for batched reads.
+
+  Talks to the kernel through the raw system calls so that there is no dependency on liburing. If the kernel (or the build) does not support io_uring, valid() returns false and the caller is expected to read the files itself.
+ */
+class Uring {
+public:
+    /** Creates ring with room for the given number of reads in flight.
+     */
+    Uring(unsigned entries);
+
+    ~Uring();
+
+    Uring(Uring const &) = delete;
+    Uring & operator = (Uring const &) = delete;
+
+    bool valid() const {
+        return fd_ >= 0;
+    }
+
+    /** Queues read of size bytes at given offset of the file into the buffer. The tag is returned with the completion.
+
+      Returns false if the submission queue is full.
+     */
+    bool read(int fd, char * buffer, size_t size, uint64_t offset, uint64_t tag);
+
+    /** Submits all queued reads and waits until at least the given number of them completes.
+
+      Throws if the kernel refuses the submission.
+     */
+    void submit(unsigned waitFor);
+
+    /** Retrieves completed read, if any.
+
+      Result is the number of bytes read, or negative errno.
+     */
+    bool complete(uint64_t & tag, int & result);
+
+    /** Drops the queued reads that were not submitted yet and waits for those in flight, discarding their completions.
+
+      Must be called before the buffers of the reads are released when a batch of reads is abandoned, since the kernel still writes into them.
+     */
+    void cancel();
+
+private:
+    int fd_;
+    unsigned entries_;
+    unsigned queued_;
+
+    /** Reads submitted to the kernel whose completions were not retrieved yet.
+     */
+    unsigned inFlight_;
+
+    void * sqRing_;
+    size_t sqRingSize_;
+    void * cqRing_;
+    size_t cqRingSize_;
+    void * sqes_;
+    size_t sqesSize_;
+
+    unsigned * sqHead_;
+    unsigned * sqTail_;
+    unsigned * sqMask_;
+    unsigned * sqArray_;
+    unsigned * cqHead_;
+    unsigned * cqTail_;
+    unsigned * cqMask_;
+    void * cqes_;
+
+    /** Vectors for the reads in flight, indexed the same as the submission queue entries.
+     */
+    std::vector<struct iovec> iovecs_;
+};
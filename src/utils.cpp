@@ -7,6 +7,7 @@
 #include <iomanip>
 #include <fstream>
 
+#include "config.h"
 #include "utils.h"
 
 char toHexDigit(unsigned from) {
@@ -76,19 +77,17 @@ std::string unescapePath(std::string const & from) {
     return result;
 }
 
-std::string loadEntireFile(std::string const & filename) {
-    std::ifstream s(filename, std::ios::in | std::ios::binary);
-    if (not s.good())
+FileBuffer loadEntireFile(std::string const & filename) {
+    FileBuffer result;
+    if (not result.load(filename))
         throw STR("Unable to open file " << filename);
-    s.seekg(0, std::ios::end);
-    std::string result;
-    result.resize(s.tellg());
-    s.seekg(0, std::ios::beg);
-    s.read(& result[0], result.size());
-    s.close();
     return result;
 }
 
+bool isOutputFile(std::string const & filename) {
+    return isFile(filename) or isFile(filename + COMPRESSED_EXT);
+}
+
 std::vector<std::string> split(std::string const & what, char delimiter) {
     std::vector<std::string> result;
     int start = 0;
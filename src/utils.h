@@ -5,6 +5,8 @@
 #include <sstream>
 #include <chrono>
 
+#include "buffer.h"
+
 /** Shorthand for converting different types to string as long as they support the std::ostream << operator.
 */
 #define STR(WHAT) static_cast<std::stringstream&>(std::stringstream() << WHAT).str()
@@ -23,7 +25,28 @@ std::string escapePath(std::string const & from);
 std::string unescapePath(std::string const & from);
 
 
-std::string loadEntireFile(std::string const & filename);
+/** Loads the entire file into a buffer, throws if the file cannot be opened.
+ */
+FileBuffer loadEntireFile(std::string const & filename);
+
+/** Returns true if the tokenizer's output file, or its compressed version exists. Output files are read by InputBuffer.
+ */
+bool isOutputFile(std::string const & filename);
+
+/** Calls the function for each line of the buffer, without the line terminator. Stops at first empty line.
+ */
+template<typename FUNCTION>
+void forEachLine(FileBuffer const & buffer, FUNCTION f) {
+    size_t start = 0;
+    while (start < buffer.size()) {
+        char const * end = static_cast<char const *>(memchr(buffer.data() + start, '\n', buffer.size() - start));
+        size_t length = (end == nullptr ? buffer.size() : end - buffer.data()) - start;
+        if (length == 0)
+            break; // eof
+        f(std::string(buffer.data() + start, length));
+        start += length + 1;
+    }
+}
 
 
 
@@ -2,6 +2,7 @@
 #include <fstream>
 
 #include "validator.h"
+#include "writer.h"
 #include "escape_codes.h"
 #include "tokenizers/js.h"
 
@@ -36,14 +37,20 @@ void Validator::DisplayStats(double duration) {
 
 void Validator::Initialize(std::string const & outputDir) {
     outputDir_ = outputDir;
-    // load projects
-    GitProject::parseFile(STR(outputDir << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << "0" << BOOKKEEPING_PROJS_EXT));
+    unsigned shards = Writer::NumShards(outputDir);
+    if (shards == 0)
+        throw STR("No tokenizer output found in " << outputDir);
+    // load projects of all shards first, files refer to projects from any shard
+    for (unsigned i = 0; i < shards; ++i)
+        GitProject::parseFile(STR(outputDir << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << i << BOOKKEEPING_PROJS_EXT));
     Worker::Log(STR("loaded " << GitProject::NumProjects() << " projects"));
     // load file stats
-    FileStats::parseFile(STR(outputDir << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << "0" << FULL_STATS_FILE_EXT));
+    for (unsigned i = 0; i < shards; ++i)
+        FileStats::parseFile(STR(outputDir << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << i << FULL_STATS_FILE_EXT));
     Worker::Log(STR("loaded " << FileStats::NumFiles() << " file statistics"));
     // load clone info
-    CloneInfo::parseFile(STR(outputDir << "/" << PATH_CLONES_FILE << "/" << CLONES_FILE << "0" << CLONES_FILE_EXT));
+    for (unsigned i = 0; i < shards; ++i)
+        CloneInfo::parseFile(STR(outputDir << "/" << PATH_CLONES_FILE << "/" << CLONES_FILE << i << CLONES_FILE_EXT));
     Worker::Log(STR("loaded " << CloneInfo::numClones() << " clone pairs"));
 
     createDirectory(outputDir + "/" + PATH_DIFFS + "/errors");
@@ -87,7 +94,7 @@ void Validator::operator () () {
     Worker::deactivate();
 }
 
-bool Validator::checkTokensHash(std::string const & first, std::string const & second, bool ignoreWhitespace, bool ignoreComments, bool ignoreSeparators) {
+bool Validator::checkTokensHash(FileBuffer const & first, FileBuffer const & second, bool ignoreWhitespace, bool ignoreComments, bool ignoreSeparators) {
     JSTokenizer::IgnoreWhitespace() = ignoreWhitespace;
     JSTokenizer::IgnoreComments() = ignoreComments;
     JSTokenizer::IgnoreSeparators() = ignoreSeparators;
@@ -110,8 +117,8 @@ void Validator::createDiff(std::string const & subdir, FileStats * first, FileSt
 
 void Validator::analyzeDiff(FileStats * one, FileStats * two) {
     try {
-        std::string first = loadEntireFile(one->absPath());
-        std::string second = loadEntireFile(two->absPath());
+        FileBuffer first = loadEntireFile(one->absPath());
+        FileBuffer second = loadEntireFile(two->absPath());
         if (not checkTokensHash(first, second, true, true, false)) {
             ++separatorDifferent_;
             createDiff("separators", one, two);
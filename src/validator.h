@@ -45,7 +45,7 @@ public:
 
 private:
 
-    bool checkTokensHash(std::string const & first, std::string const & second, bool ignoreWhitespace, bool ignoreComments, bool ignoreSeparators);
+    bool checkTokensHash(FileBuffer const & first, FileBuffer const & second, bool ignoreWhitespace, bool ignoreComments, bool ignoreSeparators);
 
     void createDiff(std::string const & subdir, FileStats * first, FileStats * second);
 
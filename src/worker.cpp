@@ -6,10 +6,12 @@
 std::mutex Worker::m_;
 
 thread_local Worker * Worker::worker_ = nullptr;
+thread_local std::vector<Worker::Outbox *> Worker::outboxes_;
 
 std::mutex Worker::doneM_;
 std::condition_variable Worker::allDone_;
 std::atomic_uint Worker::numThreads_;
+std::atomic_uint Worker::busy_(0);
 
 
 std::ostream & operator << (std::ostream & s, Worker::Stats const & stats) {
@@ -63,14 +65,14 @@ void Worker::Log(std::string const & msg) {
 }
 
 bool Worker::WaitForFinished(int timeoutMillis) {
-    if (numThreads_ == 0)
+    if (busy_ == 0)
         return true;
     while (timeoutMillis > 0) {
         auto start = std::chrono::high_resolution_clock::now();
         std::unique_lock<std::mutex> g(doneM_);
         allDone_.wait_for(g, std::chrono::milliseconds(timeoutMillis));
         timeoutMillis -= std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
-        if (numThreads_ == 0)
+        if (busy_ == 0)
             return true;
     }
     return false;
@@ -1,11 +1,15 @@
 #pragma once
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
 #include <vector>
 #include <atomic>
+#include <algorithm>
+#include <thread>
 
 #include "utils.h"
+#include "ring.h"
+#include "parking.h"
 
 /** Basic worker thread.
 
@@ -87,13 +91,52 @@ protected:
 
     void activate() {
         ++numThreads_;
+        AddWork(1);
     }
 
     void deactivate() {
-        if (--numThreads_ == 0) {
+        --numThreads_;
+        RemoveWork(1);
+    }
+
+    /** Records given number of jobs scheduled in any stage, or a thread becoming active.
+
+      Active threads and jobs waiting in any stage are counted together, so that the pipeline is finished only when the count drops to zero. Counting them separately would allow a moment where a job is already scheduled, but the thread that will take it is not yet active again.
+     */
+    static void AddWork(unsigned n) {
+        busy_ += n;
+    }
+
+    /** Records given number of jobs taken by an active thread, or a thread parking.
+     */
+    static void RemoveWork(unsigned n) {
+        if ((busy_ -= n) == 0) {
             std::lock_guard<std::mutex> g(doneM_);
             allDone_.notify_all();
-        };
+        }
+    }
+
+    /** Jobs buffered by a thread for some stage.
+     */
+    class Outbox {
+    public:
+        virtual void flush() = 0;
+
+        bool registered = false;
+    };
+
+    /** Registers outbox of the current thread so that it is flushed when the thread runs out of work.
+     */
+    static void RegisterOutbox(Outbox * outbox) {
+        outboxes_.push_back(outbox);
+        outbox->registered = true;
+    }
+
+    /** Schedules all jobs buffered by the current thread.
+     */
+    static void FlushOutboxes() {
+        for (Outbox * o : outboxes_)
+            o->flush();
     }
 
 protected:
@@ -106,82 +149,179 @@ private:
 
     static thread_local Worker * worker_;
 
+    static thread_local std::vector<Outbox *> outboxes_;
+
     static std::mutex m_;
 
     static std::mutex doneM_;
     static std::condition_variable allDone_;
     static std::atomic_uint numThreads_;
 
+    /** Number of active threads plus the number of jobs scheduled in all stages and not yet taken.
+     */
+    static std::atomic_uint busy_;
+
 };
 
+/** Worker processing jobs of given type.
+
+  Jobs scheduled from other stages pass through the stage's channel, a bounded lock-free ring whose capacity is the queue limit. Producers that find the channel full retry a few times and then park until a consumer makes room.
+
+  Each worker thread also owns a deque of jobs. Jobs a worker schedules for its own stage go to its own deque. A worker takes the newest jobs from the back of its deque, so that it works depth first on jobs scheduling further jobs. When it runs out it takes jobs from the channel, and when the channel is empty too, it steals the older half of the jobs from the front of the deque of another worker of the same stage, i.e. the jobs closest to the root, which have the most work below them. Workers with nothing to do park until new jobs are scheduled.
+ */
 template<typename JOB>
 class QueueWorker : public Worker {
 public:
+    /** Maximum number of worker threads of a single stage.
+     */
+    static constexpr unsigned MAX_WORKERS = 256;
+
+    /** Number of attempts to add a job to a full channel before the producer parks.
+
+      The producer retries without yielding, as with more threads than cores each yield would be a switch to another thread.
+     */
+    static constexpr unsigned SPIN_LIMIT = 64;
+
+    /** Capacity of the channel until SetQueueLimit() is called.
+     */
+    static constexpr unsigned CHANNEL_CAPACITY = 1024;
+
     /** External scheduling.
-        std::unique_lock<std::mutex> g(m_);
-        while (jobs_.empty()) {
-            deactivate();
-            cv_.wait(g);
-            activate();
-        }
-        JOB result = jobs_.front();
-        jobs_.pop();
-        return result;
 
-      Blocks if the queue is too large and only adds the request when done.
+      Blocks if the channel is full and only adds the request when done.
      */
     static void Schedule(JOB const & job) {
-        std::unique_lock<std::mutex> g(m_);
-        while (jobs_.size() > queueLimit_)
-            canAdd_.wait(g);
-        jobs_.push(job);
-        cv_.notify_one();
+        AddWork(1);
+        ++queued_;
+        enqueue(job);
+        notEmpty_.notifyOne();
+    }
+
+    /** Schedules all given jobs at once, waking up the consumers only once. The vector is cleared.
+
+      Blocks while the channel is full.
+     */
+    static void ScheduleBatch(std::vector<JOB> & jobs) {
+        if (jobs.empty())
+            return;
+        AddWork(jobs.size());
+        queued_ += jobs.size();
+        for (JOB const & job : jobs)
+            enqueue(job);
+        if (jobs.size() > 1)
+            notEmpty_.notifyAll();
+        else
+            notEmpty_.notifyOne();
+        jobs.clear();
+    }
+
+    /** Buffers the job in the calling thread and schedules the buffered jobs as a batch once there is BatchSize() of them.
+
+      Worker threads flush their buffered jobs whenever they run out of their own jobs, other threads must call FlushOutboxes() themselves.
+     */
+    static void ScheduleBuffered(JOB const & job) {
+        if (batchSize_ <= 1) {
+            Schedule(job);
+            return;
+        }
+        if (not outbox_.registered)
+            RegisterOutbox(& outbox_);
+        outbox_.jobs.push_back(job);
+        if (outbox_.jobs.size() >= batchSize_)
+            ScheduleBatch(outbox_.jobs);
+    }
+
+    /** Number of jobs moved between the stages at once by ScheduleBuffered(), and the maximum number of jobs a worker takes at once.
+
+      1, the default, moves jobs one by one.
+     */
+    static unsigned & BatchSize() {
+        return batchSize_;
     }
 
     /** Run method of the thread.
      */
     void operator () () {
         Worker::Log("Started...");
+        std::vector<JOB> jobs;
         while (true) {
-            JOB job = getJob();
-            processAndCheck(job);
+            getJobs(jobs, batchSize_);
+            for (JOB const & job : jobs)
+                processAndCheck(job);
         }
     }
 
     /** Returns stats about current workers.
      */
     static Stats Statistic() {
-        std::lock_guard<std::mutex> g(m_);
-        return Stats(activeThreads_, jobs_.size(), jobsDone_, errors_);
+        return Stats(activeThreads_, queued_, jobsDone_, errors_);
     }
 
     static unsigned QueueLength() {
-        std::lock_guard<std::mutex> g(m_);
-        return jobs_.size();
+        return queued_;
+    }
+
+    /** Stops the workers of the stage from taking new jobs until Resume() is called.
+
+      Jobs can still be scheduled for the stage. Workers finish the jobs they already took and schedule the jobs they buffered for other stages before they stop, see Paused().
+     */
+    static void Pause() {
+        paused_ = true;
+    }
+
+    /** Returns true once the stage is paused and none of its workers is active, i.e. all jobs taken before the pause are done.
+     */
+    static bool Paused() {
+        return paused_ and activeThreads_ == 0;
+    }
+
+    static void Resume() {
+        paused_ = false;
+        resumed_.notifyAll();
     }
 
+    /** Sets the capacity of the channel.
+
+      Must be called before any jobs are scheduled.
+     */
     static void SetQueueLimit(unsigned limit) {
         queueLimit_ = limit;
+        channel_.reset(limit);
     }
 
 protected:
     QueueWorker(std::string const & name):
         Worker(name) {
         // bump up the number of active threads
-        m_.lock();
         activate();
-        m_.unlock();
+        // register the worker so that it can be stolen from
+        std::lock_guard<std::mutex> g(m_);
+        if (numWorkers_ == MAX_WORKERS)
+            throw STR("Too many workers, " << name << " cannot be registered");
+        workers_[numWorkers_] = this;
+        ++numWorkers_;
+        self_ = this;
     }
 
     /** Internal scheduler.
 
-      Either appends given job to the queue, or utilizes the current thread to schedule it immediately.
+      Either appends given job to the worker's own deque, or utilizes the current thread to schedule it immediately if too many jobs are queued.
      */
     void schedule(JOB const & job) {
-        if (queueLimit_ == 0 or jobs_.size() >= queueLimit_)
+        if (queueLimit_ == 0 or queued_ >= queueLimit_) {
             processAndCheck(job);
-        else
-            Schedule(job);
+            return;
+        }
+        AddWork(1);
+        ++queued_;
+        {
+            std::lock_guard<std::mutex> g(jobsM_);
+            jobs_.push_back(job);
+            ++numJobs_;
+        }
+        // other workers can steal the job only if this one has more to do
+        if (numJobs_ > 1)
+            notEmpty_.notifyOne();
     }
 
     void activate() {
@@ -229,56 +369,232 @@ private:
      */
     virtual void process(JOB const & job) = 0;
 
-    /** Gets new piece of job from the queue, or blocks the thread if empty.
+    /** Outbox of the current thread for jobs of this stage.
+     */
+    class Batch : public Outbox {
+    public:
+        void flush() override {
+            ScheduleBatch(jobs);
+        }
+
+        std::vector<JOB> jobs;
+    };
+
+    /** Adds the job to the channel, spinning and then parking while the channel is full.
      */
-    JOB getJob() {
-        std::unique_lock<std::mutex> g(m_);
-        while (jobs_.empty()) {
+    static void enqueue(JOB const & job) {
+        for (unsigned spins = 0; not channel_.push(job); ++spins) {
+            if (spins < SPIN_LIMIT)
+                continue;
+            unsigned epoch = notFull_.prepare();
+            if (channel_.push(job)) {
+                notFull_.cancel();
+                return;
+            }
+            // jobs of the same batch already in the channel might not have been announced yet
+            notEmpty_.notifyAll();
+            notFull_.wait(epoch);
+        }
+    }
+
+    /** Gets up to n jobs from own deque, the channel, or other workers, or parks the thread if there are no jobs.
+
+      The newest jobs of the deque are taken, at most half of them so that the rest can be stolen by other workers. Buffered jobs of the thread are scheduled before it looks for jobs elsewhere.
+     */
+    void getJobs(std::vector<JOB> & into, unsigned n) {
+        into.clear();
+        n = std::max(n, 1u);
+        while (true) {
+            if (paused_) {
+                pause();
+                continue;
+            }
+            std::unique_lock<std::mutex> g(jobsM_);
+            if (not jobs_.empty()) {
+                size_t take = std::min<size_t>(n, (jobs_.size() + 1) / 2);
+                into.insert(into.end(), jobs_.end() - take, jobs_.end());
+                jobs_.erase(jobs_.end() - take, jobs_.end());
+                numJobs_ -= take;
+                g.unlock();
+                queued_ -= take;
+                RemoveWork(take);
+                return;
+            }
+            g.unlock();
+            FlushOutboxes();
+            while (into.size() < n and channel_.pop(into)) {
+            }
+            if (not into.empty()) {
+                queued_ -= into.size();
+                RemoveWork(into.size());
+                notFull_.notifyAll();
+                // there may be more jobs for others
+                if (into.size() == n)
+                    notEmpty_.notifyOne();
+                return;
+            }
+            if (steal())
+                continue;
+            unsigned epoch = notEmpty_.prepare();
+            if (queued_ > 0) {
+                notEmpty_.cancel();
+                std::this_thread::yield();
+                continue;
+            }
             deactivate();
-            cv_.wait(g);
+            notEmpty_.wait(epoch);
             activate();
         }
-        JOB result = jobs_.front();
-        jobs_.pop();
-        if (jobs_.size() < queueLimit_)
-            canAdd_.notify_all();
-        return result;
     }
 
-    static unsigned activeThreads_;
-    static unsigned jobsDone_;
-    static unsigned errors_;
+    /** Parks the thread while the stage is paused, scheduling its buffered jobs first.
+     */
+    void pause() {
+        FlushOutboxes();
+        unsigned epoch = resumed_.prepare();
+        if (not paused_) {
+            resumed_.cancel();
+            return;
+        }
+        deactivate();
+        resumed_.wait(epoch);
+        activate();
+    }
+
+    /** Moves the older half of the jobs of another worker to own deque.
+
+      Returns false if there was nothing to take.
+     */
+    bool steal() {
+        std::vector<JOB> & taken = stolen_;
+        taken.clear();
+        unsigned n = numWorkers_;
+        for (unsigned i = 0; i < n and taken.empty(); ++i) {
+            QueueWorker * victim = workers_[(victimStart_ + i) % n];
+            if (victim == this or victim->numJobs_ == 0)
+                continue;
+            // the victim's lock is released before own deque is locked so that two workers stealing from each other cannot deadlock
+            std::lock_guard<std::mutex> g(victim->jobsM_);
+            size_t steal = (victim->jobs_.size() + 1) / 2;
+            taken.insert(taken.end(), victim->jobs_.begin(), victim->jobs_.begin() + steal);
+            victim->jobs_.erase(victim->jobs_.begin(), victim->jobs_.begin() + steal);
+            victim->numJobs_ -= steal;
+        }
+        ++victimStart_;
+        if (taken.empty())
+            return false;
+        {
+            std::lock_guard<std::mutex> g(jobsM_);
+            jobs_.insert(jobs_.end(), taken.begin(), taken.end());
+            numJobs_ += taken.size();
+        }
+        // let others steal from the batch
+        if (taken.size() > 1)
+            notEmpty_.notifyOne();
+        return true;
+    }
+
+    /** Jobs of this worker and the mutex guarding them.
+     */
+    std::mutex jobsM_;
+    std::deque<JOB> jobs_;
+
+    /** Number of jobs in the deque, so that thieves can skip empty deques without locking them.
+     */
+    std::atomic_uint numJobs_{0};
+
+    /** Buffer for stolen jobs.
+     */
+    std::vector<JOB> stolen_;
+
+    /** Worker to start looking for jobs to steal at.
+     */
+    unsigned victimStart_ = 0;
+
+    static thread_local QueueWorker * self_;
+
+    static thread_local Batch outbox_;
+
+    static QueueWorker * workers_[MAX_WORKERS];
+    static std::atomic_uint numWorkers_;
+
+    /** Channel through which the jobs from other stages arrive.
+     */
+    static Ring<JOB> channel_;
+
+    /** Total number of jobs in the channel and all deques, including those being added.
+     */
+    static std::atomic_uint queued_;
+
+    /** Workers wait here for new jobs, producers for room in the channel.
+     */
+    static Parking notEmpty_;
+    static Parking notFull_;
+
+    /** Paused workers wait here, see Pause().
+     */
+    static std::atomic_bool paused_;
+    static Parking resumed_;
+
+    static std::atomic_uint activeThreads_;
+    static std::atomic_uint jobsDone_;
+    static std::atomic_uint errors_;
+
+    /** Mutex guarding registration of the workers.
+     */
     static std::mutex m_;
-    static std::condition_variable cv_;
-    static std::condition_variable canAdd_;
-    static std::queue<JOB> jobs_;
 
     static unsigned queueLimit_;
+    static unsigned batchSize_;
 };
 
 template<typename JOB>
-unsigned QueueWorker<JOB>::activeThreads_ = 0;
+thread_local QueueWorker<JOB> * QueueWorker<JOB>::self_ = nullptr;
 
 template<typename JOB>
-unsigned QueueWorker<JOB>::jobsDone_ = 0;
+thread_local typename QueueWorker<JOB>::Batch QueueWorker<JOB>::outbox_;
 
 template<typename JOB>
-unsigned QueueWorker<JOB>::errors_ = 0;
+QueueWorker<JOB> * QueueWorker<JOB>::workers_[MAX_WORKERS];
 
 template<typename JOB>
-std::mutex QueueWorker<JOB>::m_;
+std::atomic_uint QueueWorker<JOB>::numWorkers_(0);
+
+template<typename JOB>
+Ring<JOB> QueueWorker<JOB>::channel_(CHANNEL_CAPACITY);
+
+template<typename JOB>
+std::atomic_uint QueueWorker<JOB>::queued_(0);
+
+template<typename JOB>
+Parking QueueWorker<JOB>::notEmpty_;
+
+template<typename JOB>
+Parking QueueWorker<JOB>::notFull_;
+
+template<typename JOB>
+std::atomic_bool QueueWorker<JOB>::paused_(false);
+
+template<typename JOB>
+Parking QueueWorker<JOB>::resumed_;
+
+template<typename JOB>
+std::atomic_uint QueueWorker<JOB>::activeThreads_(0);
+
+template<typename JOB>
+std::atomic_uint QueueWorker<JOB>::jobsDone_(0);
 
 template<typename JOB>
-std::condition_variable QueueWorker<JOB>::cv_;
+std::atomic_uint QueueWorker<JOB>::errors_(0);
 
 template<typename JOB>
-std::condition_variable QueueWorker<JOB>::canAdd_;
+std::mutex QueueWorker<JOB>::m_;
 
 template<typename JOB>
-std::queue<JOB> QueueWorker<JOB>::jobs_;
+unsigned QueueWorker<JOB>::queueLimit_ = 0;
 
 template<typename JOB>
-unsigned QueueWorker<JOB>::queueLimit_;
+unsigned QueueWorker<JOB>::batchSize_ = 1;
 
 template<typename JOB>
 class QueueProcessor : public QueueWorker<JOB> {
@@ -2,7 +2,9 @@
 
 #include "utils.h"
 
+#include "binary.h"
 #include "writer.h"
+#include "merger.h"
 
 
 
@@ -12,30 +14,144 @@ std::ostream & operator << (std::ostream & s, WriterJob const & job) {
     return s;
 }
 
+std::vector<Writer::Shard *> Writer::shards_;
+
 std::string Writer::outputDir_;
 
+Writer::Format Writer::format_ = Writer::Format::text;
+
+int Writer::compressionLevel_ = 0;
+
+bool Writer::append_ = false;
+
+Writer::Shard::Shard(unsigned index) {
+    openOutputFile(projs, STR(outputDir_ << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << index << BOOKKEEPING_PROJS_EXT));
+    openOutputFile(clones, STR(outputDir_ << "/" << PATH_CLONES_FILE << "/" << CLONES_FILE << index << CLONES_FILE_EXT));
+    if (text()) {
+        openOutputFile(files, STR(outputDir_ << "/" << PATH_STATS_FILE << "/" << STATS_FILE << index << STATS_FILE_EXT));
+        openOutputFile(tokens, STR(outputDir_ << "/" << PATH_TOKENS_FILE << "/" << TOKENS_FILE << index << TOKENS_FILE_EXT));
+        openOutputFile(fullStats, STR(outputDir_ << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << index << FULL_STATS_FILE_EXT));
+    }
+    if (binary()) {
+        openBinary(binaryTokens, STR(outputDir_ << "/" << PATH_TOKENS_FILE << "/" << TOKENS_FILE << index << BINARY_EXT), TOKENS_BINARY_MAGIC);
+        openBinary(binaryStats, STR(outputDir_ << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << index << BINARY_EXT), FULL_STATS_BINARY_MAGIC);
+        openBinary(binaryPaths, STR(outputDir_ << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_PATHS_FILE << index << BINARY_EXT), FULL_STATS_PATHS_BINARY_MAGIC, true);
+    }
+    openOutputFile(manifest, STR(outputDir_ << "/" << PATH_MANIFEST << "/" << MANIFEST_FILE << index << MANIFEST_FILE_EXT));
+}
+
+void Writer::Shard::close() {
+    std::lock_guard<std::mutex> g(m);
+    files.close();
+    projs.close();
+    tokens.close();
+    clones.close();
+    fullStats.close();
+    binaryTokens.close();
+    binaryStats.close();
+    binaryPaths.close();
+    manifest.close();
+}
+
+void Writer::Shard::sync(std::function<void(std::string const &, uint64_t)> const & f) {
+    std::lock_guard<std::mutex> g(m);
+    for (OutputBuffer * o : { & files, & projs, & tokens, & clones, & fullStats, & binaryTokens, & binaryStats, & binaryPaths, & manifest })
+        if (o->isOpen())
+            f(o->filename(), o->sync());
+}
+
+Writer::Format Writer::ParseFormat(std::string const & name) {
+    if (name == "text")
+        return Format::text;
+    if (name == "binary")
+        return Format::binary;
+    if (name == "both")
+        return Format::both;
+    throw STR("Unknown output format " << name);
+}
+
+void Writer::ConvertToText(std::string const & outputDir) {
+    unsigned shards = NumShards(outputDir);
+    if (shards == 0)
+        throw STR("No tokenizer output found in " << outputDir);
+    for (unsigned i = 0; i < shards; ++i)
+        GitProject::parseFile(STR(outputDir << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << i << BOOKKEEPING_PROJS_EXT));
+    for (unsigned i = 0; i < shards; ++i)
+        FileStats::parseBinaryFile(
+            STR(outputDir << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << i << BINARY_EXT),
+            STR(outputDir << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_PATHS_FILE << i << BINARY_EXT));
+    for (unsigned i = 0; i < shards; ++i) {
+        // files are routed to shards by their ids, so the full stats of the shard can be recovered from all stats
+        OutputBuffer fullStats;
+        fullStats.open(STR(outputDir << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << i << FULL_STATS_FILE_EXT));
+        size_t first = FILE_ID_STARTS_AT + (i + shards - FILE_ID_STARTS_AT % shards) % shards;
+        for (size_t fid = first, e = FILE_ID_STARTS_AT + FileStats::NumFiles(); fid < e; fid += shards) {
+            FileStats * fs = FileStats::get(fid);
+            if (fs != nullptr)
+                fs->writeFullStats(fullStats);
+        }
+        // sourcererCC's stats are written for exactly those files whose tokens are written
+        OutputBuffer files;
+        files.open(STR(outputDir << "/" << PATH_STATS_FILE << "/" << STATS_FILE << i << STATS_FILE_EXT));
+        OutputBuffer tokens;
+        tokens.open(STR(outputDir << "/" << PATH_TOKENS_FILE << "/" << TOKENS_FILE << i << TOKENS_FILE_EXT));
+        TokensReader reader(STR(outputDir << "/" << PATH_TOKENS_FILE << "/" << TOKENS_FILE << i << BINARY_EXT));
+        unsigned fid;
+        TokenIds ids;
+        while (reader.next(fid, ids)) {
+            FileStats * fs = FileStats::get(fid);
+            if (fs == nullptr)
+                throw STR("No statistics for file " << fid);
+            fs->writeSourcererStats(files);
+            fs->writeTokens(ids, tokens);
+        }
+    }
+    DictionaryReader dictionary(STR(outputDir << "/" << GLOBAL_TOKENS_FILE << BINARY_EXT));
+    OutputBuffer globalTokens;
+    globalTokens.open(STR(outputDir << "/" << GLOBAL_TOKENS_FILE << GLOBAL_TOKENS_FILE_EXT));
+    unsigned id;
+    unsigned count;
+    std::string token;
+    while (dictionary.next(id, count, token))
+        globalTokens << id << "," << count << "," << token.size() << "," << escapeToken(token) << '\n';
+}
+
 Writer::Writer(unsigned index):
     QueueProcessor<WriterJob>(STR("WRITER " << index)) {
-    openStreamAndCheck(files_, STR(outputDir_ << "/" << PATH_STATS_FILE << "/" << STATS_FILE << index << STATS_FILE_EXT));
-    openStreamAndCheck(projs_, STR(outputDir_ << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << index << BOOKKEEPING_PROJS_EXT));
-    openStreamAndCheck(tokens_, STR(outputDir_ << "/" << PATH_TOKENS_FILE << "/" << TOKENS_FILE << index << TOKENS_FILE_EXT));
-    openStreamAndCheck(clones_, STR(outputDir_ << "/" << PATH_CLONES_FILE << "/" << CLONES_FILE << index << CLONES_FILE_EXT));
-    openStreamAndCheck(fullStats_, STR(outputDir_ << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << index << FULL_STATS_FILE_EXT));
-
 }
 
-void Writer::initializeOutputDirectory(std::string const & output) {
+void Writer::initializeOutputDirectory(std::string const & output, bool append) {
     outputDir_ = output;
-    if (isDirectory(output))
+    append_ = append;
+    if (append) {
+        if (NumShards(output) == 0)
+            throw STR("No tokenizer output to append to found in " << output);
+        // new output must match the existing one
+        std::string first = STR(output << "/" << PATH_FULL_STATS_FILE << "/" << FULL_STATS_FILE << 0);
+        bool text = isOutputFile(first + FULL_STATS_FILE_EXT);
+        bool binary = isOutputFile(first + BINARY_EXT);
+        format_ = text and binary ? Format::both : (binary ? Format::binary : Format::text);
+        if (isFile(STR(output << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << 0 << BOOKKEEPING_PROJS_EXT << COMPRESSED_EXT)))
+            compressionLevel_ = std::max(compressionLevel_, 1);
+        else
+            compressionLevel_ = 0;
+    } else if (isDirectory(output)) {
         Worker::Warning(STR("Output directory " << output << " already exists, data may be corrupted"));
+    }
     createDirectory(output + "/" + PATH_STATS_FILE);
     createDirectory(output + "/" + PATH_BOOKKEEPING_PROJS);
     createDirectory(output + "/" + PATH_TOKENS_FILE);
     createDirectory(output + "/" + PATH_CLONES_FILE);
     createDirectory(output + "/" + PATH_FULL_STATS_FILE);
+    createDirectory(output + "/" + PATH_MANIFEST);
 }
 
 void Writer::initializeWorkers(unsigned num) {
+    if (append_)
+        num = NumShards(outputDir_);
+    // the shards must all exist before the first job is processed
+    for (unsigned i = 0; i < num; ++i)
+        shards_.push_back(new Shard(i));
     for (unsigned i = 0; i < num; ++i) {
         std::thread t([i] () {
             Writer c(i);
@@ -45,32 +161,89 @@ void Writer::initializeWorkers(unsigned num) {
     }
 }
 
-void Writer::openStreamAndCheck(std::ofstream & s, std::string const & filename) {
-    s.open(filename);
-    if (not s.good())
-        throw STR("Unable to open file " << filename << " for writing");
+void Writer::closeOutput() {
+    for (Shard * shard : shards_)
+        shard->close();
 }
 
+void Writer::Sync(std::function<void(std::string const &, uint64_t)> f) {
+    for (Shard * shard : shards_)
+        shard->sync(f);
+}
+
+void Writer::openOutputFile(OutputBuffer & f, std::string const & filename) {
+    if (compressionLevel_ == 0)
+        f.open(filename, 0, append_);
+    else
+        f.open(filename + COMPRESSED_EXT, compressionLevel_, append_);
+}
+
+void Writer::createOutputFile(OutputBuffer & f, std::string const & filename) {
+    if (compressionLevel_ == 0)
+        f.open(filename);
+    else
+        f.open(filename + COMPRESSED_EXT, compressionLevel_);
+}
+
+unsigned Writer::NumShards(std::string const & outputDir) {
+    // projects are written as text in all output formats
+    unsigned result = 0;
+    while (isOutputFile(STR(outputDir << "/" << PATH_BOOKKEEPING_PROJS << "/" << BOOKKEEPING_PROJS << result << BOOKKEEPING_PROJS_EXT)))
+        ++result;
+    return result;
+}
 
-void Writer::process(WriterJob const & job) {
 
-    // always output full stats
-    job.file->stats.uniqueTokens_ = job.file->tokens.size();
-    job.file->stats.writeFullStats(fullStats_);
-
-    // if not empty and not clone, output sourcererCC's info
-    if (not job.file->empty()) {
-        if (not job.isClone()) {
-            job.file->stats.writeSourcererStats(files_);
-            job.file->writeTokens(tokens_);
-        } else {
-            CloneInfo ci(job.originalPid, job.originalFid, job.file->pid(), job.file->id());
-            ci.writeTo(clones_);
+void Writer::openBinary(OutputBuffer & f, std::string const & filename, char const * magic, bool offsets) {
+    InputBuffer existing;
+    bool exists = append_ and (compressionLevel_ != 0 and offsets ? existing.open(filename) : isOutputFile(filename));
+    openOutputFile(f, filename);
+    if (not exists) {
+        f << magic;
+    } else if (compressionLevel_ != 0 and offsets) {
+        // offsets continue from the uncompressed size, which is only known by inflating the whole file
+        existing.skip(UINT64_MAX);
+        f.setOffset(existing.offset());
+    }
+}
+
+void Writer::process(WriterJob const & job) {
+    Shard & shard = * shards_[job.file->id() % shards_.size()];
+    {
+        std::lock_guard<std::mutex> g(shard.m);
+
+        // always output full stats
+        job.file->stats.uniqueTokens_ = job.file->ids.size();
+        if (text())
+            job.file->stats.writeFullStats(shard.fullStats);
+        if (binary())
+            job.file->stats.writeBinaryStats(shard.binaryStats, shard.binaryPaths);
+
+        // if not empty and not clone, output sourcererCC's info
+        if (not job.file->empty()) {
+            if (not job.isClone()) {
+                if (text()) {
+                    job.file->stats.writeSourcererStats(shard.files);
+                    job.file->writeTokens(shard.tokens);
+                }
+                if (binary())
+                    job.file->writeBinaryTokens(shard.binaryTokens);
+            } else {
+                CloneInfo ci(job.originalPid, job.originalFid, job.file->pid(), job.file->id());
+                ci.writeTo(shard.clones);
+            }
         }
+        // finally check if the project should be written as well
+        if (job.writeProject)
+            job.file->project()->writeTo(shard.projs);
+
+        shard.manifest << job.file->id() << ","
+                       << job.file->pid() << ","
+                       << (job.isClone() ? 0 : 1) << ","
+                       << job.file->contentsHash << ","
+                       << Merger::CloneDigest(job.file) << ","
+                       << escapePath(job.file->stats.relPath()) << '\n';
     }
-    // finally check if the project should be written as well
-    if (job.writeProject)
-        job.file->project()->writeTo(projs_);
 
     processedBytes_ += job.file->stats.bytes();
     ++processedFiles_;
@@ -1,7 +1,12 @@
-#include <fstream>
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #include "worker.h"
 #include "data.h"
+#include "output.h"
 
 
 struct WriterJob {
@@ -37,33 +42,137 @@ struct WriterJob {
     friend std::ostream & operator << (std::ostream & s, WriterJob const & job);
 };
 
+/** Writes the results of the merger.
+
+  The output is split into shards, each with its own set of output files suffixed with the shard index. Files are routed to shards by their id so that all output for a single file lands in the same shard. Any writer thread may write into any shard, the shard is locked while it does so, and there are as many shards as writer threads.
+
+  The output files are large append only buffers, which are only written when full, or when closeOutput() is called after all work is done. If CompressionLevel() is not 0, all output files are gzip compressed, each shard's files by the writer thread holding the shard.
+
+  The tokens and statistics of the files can be written in sourcererCC's text format, in a compact binary format (see BinaryInput), or both. Projects and clone pairs are always written as text. Binary output can be converted to text later by ConvertToText().
+ */
 class Writer: public QueueProcessor<WriterJob> {
 public:
+    enum class Format {
+        text,
+        binary,
+        both,
+    };
+
     Writer(unsigned index);
 
+    static Format & OutputFormat() {
+        return format_;
+    }
+
+    /** Returns the output format of given name, throws if there is no such format.
+     */
+    static Format ParseFormat(std::string const & name);
+
+    /** Converts the binary output in given directory to the text format.
+
+      Text files of all shards are (re)created from their binary counterparts, as is the global tokens file.
+     */
+    static void ConvertToText(std::string const & outputDir);
+
     /** Initializes the given output directory.
 
       Makes sure all teh subdirs exist. If they do, reports a warning as data might be corrupted.
+
+      If append is true, the output directory must contain output of a previous run, to which the new output is appended. The output format and compression are then those of the existing output.
      */
-    static void initializeOutputDirectory(std::string const & output);
+    static void initializeOutputDirectory(std::string const & output, bool append = false);
 
+    /** Opens the given number of output shards and starts a writer thread for each of them.
+
+      When appending, the number of shards is that of the existing output, since files are routed to shards by their ids.
+     */
     static void initializeWorkers(unsigned num);
 
+    /** Flushes and closes the output files of all shards.
+
+      Must be called once all jobs are done, otherwise the output files may be incomplete, or their compressed streams not terminated.
+     */
+    static void closeOutput();
+
+    /** Writes all output of the shards to disk and calls the function with the name and size of each output file.
+
+      Must only be called when no writer is active, see Checkpoint.
+     */
+    static void Sync(std::function<void(std::string const &, uint64_t)> f);
+
+    /** Opens the output file, compressed if output compression is on, in which case COMPRESSED_EXT is appended to its name.
+
+      Appends to the file if the output is being appended to.
+     */
+    static void openOutputFile(OutputBuffer & f, std::string const & filename);
+
+    /** Opens the output file like openOutputFile(), but always truncates it, for files that are rewritten as a whole, such as the global tokens.
+     */
+    static void createOutputFile(OutputBuffer & f, std::string const & filename);
+
+    /** zlib compression level of the output files, 0 (the default) for no compression.
+     */
+    static int & CompressionLevel() {
+        return compressionLevel_;
+    }
+
+    /** Returns the number of output shards in given output directory.
+     */
+    static unsigned NumShards(std::string const & outputDir);
+
 private:
 
-    static void openStreamAndCheck(std::ofstream & s, std::string const & filename);
+    /** Output files of a single shard.
+     */
+    class Shard {
+    public:
+        Shard(unsigned index);
+
+        std::mutex m;
+
+        OutputBuffer files;
+        OutputBuffer projs;
+        OutputBuffer tokens;
+        OutputBuffer clones;
+        OutputBuffer fullStats;
+
+        OutputBuffer binaryTokens;
+        OutputBuffer binaryStats;
+        OutputBuffer binaryPaths;
+
+        OutputBuffer manifest;
+
+        void close();
 
-    /** Writer just outputs the information stored into the respective output streams.
+        void sync(std::function<void(std::string const &, uint64_t)> const & f);
+    };
+
+    /** Opens the binary file and writes its magic, unless appending to an existing file.
+
+      If offsets into the file are recorded elsewhere, they must continue after existing data, which for compressed files requires decompressing them first.
+     */
+    static void openBinary(OutputBuffer & f, std::string const & filename, char const * magic, bool offsets = false);
+
+    static bool text() {
+        return format_ != Format::binary;
+    }
+
+    static bool binary() {
+        return format_ != Format::text;
+    }
+
+    /** Writer just outputs the information stored into the respective output files of the shard the file belongs to.
      */
     void process(WriterJob const & job) override;
 
-    std::ofstream files_;
-    std::ofstream projs_;
-    std::ofstream tokens_;
-    std::ofstream clones_;
-    std::ofstream fullStats_;
+    static std::vector<Shard *> shards_;
 
     static std::string outputDir_;
 
-};
+    static Format format_;
 
+    static int compressionLevel_;
+
+    static bool append_;
+
+};
@@ -0,0 +1,1026 @@
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/binary.h"
+#include "../src/crawler.h"
+#include "../src/data.h"
+#include "../src/dictionary.h"
+#include "../src/output.h"
+#include "../src/parking.h"
+#include "../src/ring.h"
+#include "../src/tokenizers/generic.h"
+#include "../src/tokenizers/js.h"
+#include "../src/tokenizers/scan.h"
+
+/** Microbenchmarks of the hot paths of the tokenizer, each next to the simpler implementation it replaced.
+
+  - dictionary: the merger's interning of token views into global ids with 1 to 8 threads, against a single mutex guarded unordered_map of strings with the counts under another mutex
+  - tokenmap: TokenizedFile::addToken and the hash of the file's tokens, against a std::map of the token views, on generated tokens or with tokenmap=DIR on the tokens of the JavaScript files in DIR
+  - js: JSTokenizer throughput on minified and formatted code with each instruction set the cpu supports, scalar being the lookup table alone
+  - hash: the md5 and murmur3 hashers on file sized buffers, and the rate of tokenizing and hashing generated files, or with hash=DIR the JavaScript files in DIR, with each of them
+  - writer: the text stats and tokens records formatted into OutputBuffer, against iostreams ending each record with std::endl
+  - ring: jobs per second passed from producers to consumers, given as producers/consumers, through the channel of the workers, the lock-free ring with parking, against a bounded std::queue guarded by a mutex with two condition variables
+  - queue: jobs per second of a tree of jobs scheduling their children, processed by the work stealing workers with 8 to 64 threads, against a single mutex guarded std::queue with condition variables
+  - crawler: directories per second crawled by the Crawler with 1 and 8 threads, against recursive readdir with lstat of every entry
+
+  Unless given, the inputs are generated, so that the runs are repeatable. Each measurement is the best of several runs. Sections to run can be given as arguments, all run by default. The crawler should run last, as its threads cannot be stopped.
+ */
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr unsigned RUNS = 3;
+
+    /** Returns the shortest time in seconds of several runs of the function, each prepared by the setup which is not measured.
+     */
+    template<typename SETUP, typename FUNCTION>
+    double best(SETUP setup, FUNCTION f) {
+        double result = 0;
+        for (unsigned i = 0; i < RUNS; ++i) {
+            setup();
+            auto start = Clock::now();
+            f();
+            double t = std::chrono::duration<double>(Clock::now() - start).count();
+            if (i == 0 or t < result)
+                result = t;
+        }
+        return result;
+    }
+
+    template<typename FUNCTION>
+    double best(FUNCTION f) {
+        return best([] () { }, f);
+    }
+
+    void report(std::string const & what, double value, char const * unit) {
+        std::cout << "    " << std::left << std::setw(40) << what << std::right << std::fixed << std::setprecision(1) << std::setw(10) << value << " " << unit << std::endl;
+    }
+
+    /** Keeps the compiler from optimizing away results which are not used otherwise.
+     */
+    volatile size_t sink;
+
+    /** Vocabulary of identifier-like tokens, and streams of tokens drawn from it with a roughly Zipfian distribution, as tokens of source code are.
+     */
+    class Tokens {
+    public:
+        Tokens(unsigned vocabulary, size_t length, std::mt19937 & rng) {
+            static char const chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_$0123456789";
+            for (unsigned i = 0; i < vocabulary; ++i) {
+                std::string token(1 + rng() % 12, ' ');
+                for (char & c : token)
+                    c = chars[rng() % (sizeof(chars) - 1)];
+                // the number makes the tokens unique
+                words_.push_back(STR(token << i));
+            }
+            std::uniform_real_distribution<double> u(0, 1);
+            stream_.reserve(length);
+            for (size_t i = 0; i < length; ++i) {
+                unsigned index = static_cast<unsigned>(std::pow(static_cast<double>(vocabulary), u(rng))) - 1;
+                std::string const & w = words_[std::min(index, vocabulary - 1)];
+                stream_.push_back(TokenView(w.c_str(), w.size()));
+            }
+        }
+
+        std::vector<TokenView> const & stream() const {
+            return stream_;
+        }
+
+    private:
+        std::vector<std::string> words_;
+        std::vector<TokenView> stream_;
+    };
+
+    // dictionary ------------------------------------------------------------------
+
+    /** Number of tokens the merger interns at once, i.e. the unique tokens of a file.
+     */
+    constexpr size_t FILE_TOKENS = 256;
+
+    /** The dictionary and token counts of the merger before they were sharded, one lock for the ids and one for the counts.
+     */
+    class LockedDictionary {
+    public:
+        void tokensToIds(TokenView const * tokens, size_t n) {
+            std::vector<unsigned> ids;
+            {
+                std::lock_guard<std::mutex> g(idsM_);
+                for (size_t i = 0; i < n; ++i) {
+                    auto j = ids_.insert(std::make_pair(tokens[i].str(), ids_.size()));
+                    ids.push_back(j.first->second);
+                }
+            }
+            std::lock_guard<std::mutex> g(countsM_);
+            for (unsigned id : ids) {
+                if (id >= counts_.size())
+                    counts_.resize(id + 1);
+                ++counts_[id];
+            }
+        }
+
+    private:
+        std::mutex idsM_;
+        std::unordered_map<std::string, unsigned> ids_;
+        std::mutex countsM_;
+        std::vector<unsigned> counts_;
+    };
+
+    /** Runs the function with given number of threads, each given its own share of the stream in file sized batches.
+     */
+    template<typename FUNCTION>
+    void inThreads(unsigned numThreads, std::vector<TokenView> const & stream, FUNCTION f) {
+        std::vector<std::thread> threads;
+        size_t share = stream.size() / numThreads;
+        for (unsigned t = 0; t < numThreads; ++t) {
+            threads.push_back(std::thread([&, t] () {
+                std::vector<unsigned> counts;
+                for (size_t i = t * share, e = (t + 1) * share; i < e; i += FILE_TOKENS)
+                    f(stream.data() + i, std::min(FILE_TOKENS, e - i), counts);
+            }));
+        }
+        for (std::thread & t : threads)
+            t.join();
+    }
+
+    void dictionary(std::mt19937 & rng) {
+        Tokens tokens(200000, 8000000, rng);
+        std::vector<TokenView> const & stream = tokens.stream();
+        double mtokens = stream.size() / 1e6;
+        std::cout << "dictionary: " << stream.size() << " tokens, " << std::thread::hardware_concurrency() << " cpus" << std::endl;
+        for (unsigned numThreads : { 1, 2, 4, 8 }) {
+            double locked = best([&] () {
+                std::unique_ptr<LockedDictionary> d(new LockedDictionary());
+                inThreads(numThreads, stream, [&] (TokenView const * t, size_t n, std::vector<unsigned> &) {
+                    d->tokensToIds(t, n);
+                });
+            });
+            double sharded = best([&] () {
+                std::unique_ptr<TokenDictionary> d(new TokenDictionary());
+                inThreads(numThreads, stream, [&] (TokenView const * t, size_t n, std::vector<unsigned> & counts) {
+                    // the same as Merger::tokensToIds, with the counts of each thread merged only when written
+                    for (size_t i = 0; i < n; ++i) {
+                        unsigned id = d->idFor(t[i]);
+                        if (id >= counts.size())
+                            counts.resize(std::max<size_t>(id + 1, counts.size() * 2));
+                        ++counts[id];
+                    }
+                });
+            });
+            report(STR("locked map, " << numThreads << " threads"), mtokens / locked, "Mtokens/s");
+            report(STR("TokenDictionary, " << numThreads << " threads"), mtokens / sharded, "Mtokens/s");
+        }
+    }
+
+    // tokenmap --------------------------------------------------------------------
+
+    /** Tokens of files, each given as its stream of tokens.
+     */
+    typedef std::vector<std::pair<TokenView const *, size_t>> FileStreams;
+
+    /** Appends the paths of the files with given suffix in the directory and its subdirectories.
+     */
+    void findFiles(std::string const & dir, char const * suffix, std::vector<std::string> & into) {
+        DIR * d = opendir(dir.c_str());
+        if (d == nullptr)
+            throw STR("Unable to open directory " << dir);
+        struct dirent * ent;
+        size_t suffixLength = strlen(suffix);
+        while ((ent = readdir(d)) != nullptr) {
+            if (strcmp(ent->d_name, ".") == 0 or strcmp(ent->d_name, "..") == 0)
+                continue;
+            std::string path = dir + "/" + ent->d_name;
+            struct stat s;
+            if (lstat(path.c_str(), & s) != 0)
+                continue;
+            if (S_ISDIR(s.st_mode))
+                findFiles(path, suffix, into);
+            else if (S_ISREG(s.st_mode) and path.size() >= suffixLength and path.compare(path.size() - suffixLength, suffixLength, suffix) == 0)
+                into.push_back(path);
+        }
+        closedir(d);
+    }
+
+    /** Token streams of real JavaScript files.
+
+      The files are tokenized by the generic tokenizer the pipeline uses. It counts the tokens of a file but does not keep their order, so each file's stream holds its tokens repeated by their frequencies and shuffled.
+     */
+    class JsFileTokens {
+    public:
+        JsFileTokens(std::string const & dir, std::mt19937 & rng) {
+            std::vector<std::string> paths;
+            findFiles(dir, ".js", paths);
+            std::sort(paths.begin(), paths.end());
+            for (std::string const & path : paths) {
+                std::unique_ptr<TokenizedFile> tf(new TokenizedFile());
+                if (not tf->contents.load(path))
+                    continue;
+                try {
+                    GenericTokenizer::tokenize(tf.get());
+                } catch (...) {
+                    // archives and other files the tokenizer refuses
+                    continue;
+                }
+                std::vector<TokenView> stream;
+                for (auto const & t : tf->tokens)
+                    stream.insert(stream.end(), t.second, t.first);
+                std::shuffle(stream.begin(), stream.end(), rng);
+                if (stream.empty())
+                    continue;
+                files_.push_back(std::move(tf));
+                streams_.push_back(std::move(stream));
+            }
+        }
+
+        FileStreams files() const {
+            FileStreams result;
+            for (auto const & s : streams_)
+                result.push_back(std::make_pair(s.data(), s.size()));
+            return result;
+        }
+
+    private:
+        /** The files own the contents the tokens are views into.
+         */
+        std::vector<std::unique_ptr<TokenizedFile>> files_;
+        std::vector<std::vector<TokenView>> streams_;
+    };
+
+    void compareTokenMaps(std::string const & what, FileStreams const & files) {
+        size_t numTokens = 0;
+        for (auto const & f : files)
+            numTokens += f.second;
+        double mtokens = numTokens / 1e6;
+        double map = best([&] () {
+            for (auto const & f : files) {
+                std::map<TokenView, unsigned> freqs;
+                for (size_t i = 0; i < f.second; ++i)
+                    ++freqs[f.first[i]];
+                // the map is already sorted, so it is hashed right away
+                Hasher h;
+                for (auto const & t : freqs) {
+                    h.add(t.first.data, t.first.size);
+                    h.add(& t.second, sizeof(t.second));
+                }
+                sink = sink + h.digest().hash();
+            }
+        });
+        double flat = best([&] () {
+            for (auto const & f : files) {
+                TokenizedFile tf;
+                for (size_t i = 0; i < f.second; ++i)
+                    tf.addToken(f.first[i]);
+                tf.calculateTokensHash();
+                sink = sink + tf.stats.tokensHash().hash();
+            }
+        });
+        report(STR("std::map, " << what), mtokens / map, "Mtokens/s");
+        report(STR("TokenMap, " << what), mtokens / flat, "Mtokens/s");
+    }
+
+    /** Compares the token maps on generated token streams split into files of various sizes, or on the JavaScript files in given directory.
+     */
+    void tokenMap(std::mt19937 & rng, std::string const & input) {
+        if (not input.empty()) {
+            JsFileTokens tokens(input, rng);
+            FileStreams files = tokens.files();
+            size_t numTokens = 0;
+            for (auto const & f : files)
+                numTokens += f.second;
+            std::cout << "tokenmap: " << numTokens << " tokens in " << files.size() << " files of " << input << std::endl;
+            compareTokenMaps(STR(files.size() << " files"), files);
+            return;
+        }
+        Tokens tokens(50000, 4000000, rng);
+        std::vector<TokenView> const & stream = tokens.stream();
+        std::cout << "tokenmap: " << stream.size() << " tokens" << std::endl;
+        for (size_t fileTokens : { 100, 1000, 10000 }) {
+            FileStreams files;
+            for (size_t i = 0; i < stream.size(); i += fileTokens)
+                files.push_back(std::make_pair(stream.data() + i, std::min(fileTokens, stream.size() - i)));
+            compareTokenMaps(STR(fileTokens << " tokens per file"), files);
+        }
+    }
+
+    // js --------------------------------------------------------------------------
+
+    char const * name(ByteSet::Level level) {
+        switch (level) {
+            case ByteSet::Level::scalar:
+                return "scalar";
+            case ByteSet::Level::ssse3:
+                return "SSSE3";
+            case ByteSet::Level::avx2:
+                return "AVX2";
+        }
+        return "?";
+    }
+
+    /** Generates JavaScript source of roughly given size, either formatted with comments or minified, from the same code with fresh identifiers in each repetition.
+     */
+    std::string generateJs(size_t size, bool minified) {
+        static char const * formatted =
+            "/**\n"
+            " * Renders the list of items into the container.\n"
+            " */\n"
+            "function render@(container, items, options) {\n"
+            "    // defaults for the options not given\n"
+            "    var settings@ = Object.assign({}, defaults, options || {});\n"
+            "    let count = 0, total = items.length * 1.5e3 + 0x1f;\n"
+            "    for (let i = 0; i < items.length; ++i) {\n"
+            "        const item = items[i];\n"
+            "        if (item.visible && !item.deleted) {\n"
+            "            container.appendChild(createElement@(\"div\", { className: 'item ' + item.kind, title: `item ${i}` }));\n"
+            "            count += item.weight >>> 0;\n"
+            "        } else {\n"
+            "            console.log(\"skipping item\", i, item.name);\n"
+            "        }\n"
+            "    }\n"
+            "    return count === total ? null : { count: count, total: total };\n"
+            "}\n"
+            "\n";
+        static char const * min =
+            "function render@(a,b,c){var settings@=Object.assign({},defaults,c||{});let d=0,e=b.length*1.5e3+0x1f;"
+            "for(let f=0;f<b.length;++f){const g=b[f];if(g.visible&&!g.deleted){a.appendChild(createElement@(\"div\",{className:'item '+g.kind,title:`item ${f}`}));"
+            "d+=g.weight>>>0}else{console.log(\"skipping item\",f,g.name)}}return d===e?null:{count:d,total:e}}";
+        std::string result;
+        for (unsigned i = 0; result.size() < size; ++i) {
+            for (char const * c = minified ? min : formatted; *c != 0; ++c) {
+                if (*c == '@')
+                    result += std::to_string(i);
+                else
+                    result.push_back(*c);
+            }
+        }
+        return result;
+    }
+
+    void js() {
+        constexpr size_t FILE_SIZE = 16 * 1024;
+        constexpr size_t NUM_FILES = 256;
+        ByteSet::Level supported = ByteSet::InstructionSet();
+        std::cout << "js: " << NUM_FILES << " files of " << FILE_SIZE / 1024 << " KB" << std::endl;
+        for (bool minified : { false, true }) {
+            std::string source = generateJs(FILE_SIZE, minified);
+            double mbytes = source.size() * NUM_FILES / 1e6;
+            for (ByteSet::Level level : { ByteSet::Level::scalar, ByteSet::Level::ssse3, ByteSet::Level::avx2 }) {
+                if (level > supported)
+                    break;
+                ByteSet::InstructionSet() = level;
+                std::vector<std::unique_ptr<TokenizedFile>> files(NUM_FILES);
+                double t = best([&] () {
+                    // the tokenizer normalizes the contents in place, so they are copied for each run
+                    for (auto & f : files) {
+                        f.reset(new TokenizedFile());
+                        f->contents.assign(std::string(source));
+                    }
+                }, [&] () {
+                    for (auto & f : files)
+                        JSTokenizer::tokenize(f.get());
+                });
+                sink = sink + files.back()->stats.totalTokens;
+                report(STR((minified ? "minified, " : "formatted, ") << name(level)), mbytes / t, "MB/s");
+            }
+        }
+        ByteSet::InstructionSet() = supported;
+    }
+
+    // hash ------------------------------------------------------------------------
+
+    void hash(std::mt19937 & rng, std::string const & input) {
+        std::string data(64 * 1024 * 1024, ' ');
+        for (char & c : data)
+            c = static_cast<char>(rng() & 0xff);
+        double mbytes = data.size() / 1e6;
+        std::cout << "hash: " << data.size() / (1024 * 1024) << " MB" << std::endl;
+        Hasher::Kind algorithm = Hasher::Algorithm();
+        for (size_t fileSize : { 1024, 16 * 1024, 1024 * 1024 }) {
+            for (Hasher::Kind kind : { Hasher::Kind::md5, Hasher::Kind::murmur3 }) {
+                Hasher::Algorithm() = kind;
+                double t = best([&] () {
+                    for (size_t i = 0; i < data.size(); i += fileSize) {
+                        Hasher h;
+                        h.add(data.data() + i, fileSize);
+                        sink = sink + h.digest().hash();
+                    }
+                });
+                report(STR((kind == Hasher::Kind::md5 ? "md5, " : "murmur3, ") << fileSize / 1024 << " KB files"), mbytes / t, "MB/s");
+            }
+        }
+        // the tokenize rate, i.e. what the tokenizer stage does with each file: tokenizing it, which hashes its contents, and hashing its tokens
+        std::vector<std::string> sources;
+        if (input.empty()) {
+            for (unsigned i = 0; i < 256; ++i)
+                sources.push_back(generateJs(16 * 1024, i % 2 == 1));
+        } else {
+            std::vector<std::string> paths;
+            findFiles(input, ".js", paths);
+            std::sort(paths.begin(), paths.end());
+            for (std::string const & path : paths) {
+                FileBuffer contents;
+                if (contents.load(path))
+                    sources.push_back(std::string(contents.data(), contents.size()));
+            }
+        }
+        size_t bytes = 0;
+        for (std::string const & source : sources)
+            bytes += source.size();
+        std::cout << "hash: tokenizing " << sources.size() << " files, " << bytes / 1024 << " KB" << (input.empty() ? "" : " of " + input) << std::endl;
+        std::vector<std::unique_ptr<TokenizedFile>> files(sources.size());
+        for (Hasher::Kind kind : { Hasher::Kind::md5, Hasher::Kind::murmur3 }) {
+            Hasher::Algorithm() = kind;
+            double t = best([&] () {
+                // the tokenizer normalizes the contents in place, so they are copied for each run
+                for (size_t i = 0; i < sources.size(); ++i) {
+                    files[i].reset(new TokenizedFile());
+                    files[i]->contents.assign(std::string(sources[i]));
+                }
+            }, [&] () {
+                for (auto & f : files) {
+                    try {
+                        GenericTokenizer::tokenize(f.get());
+                    } catch (...) {
+                        // archives the tokenizer refuses
+                        continue;
+                    }
+                    f->calculateTokensHash();
+                }
+            });
+            sink = sink + files.back()->stats.tokensHash().hash();
+            report(STR((kind == Hasher::Kind::md5 ? "md5" : "murmur3") << ", tokenize and hash"), bytes / 1e6 / t, "MB/s");
+        }
+        Hasher::Algorithm() = algorithm;
+    }
+
+    // writer ----------------------------------------------------------------------
+
+    /** Writes the full stats, sourcererCC stats and tokens records of the files the way the writer did before OutputBuffer, formatting with iostreams and ending each record with std::endl.
+     */
+    void writeStreams(std::vector<std::unique_ptr<TokenizedFile>> const & files, unsigned repeat, std::string const & dir) {
+        std::ofstream fullStats(dir + "/stats-full.txt");
+        std::ofstream stats(dir + "/files-stats.txt");
+        std::ofstream tokens(dir + "/files-tokens.txt");
+        for (unsigned r = 0; r < repeat; ++r) {
+            for (auto const & f : files) {
+                TokenizedFile const & tf = *f;
+                FileStats const & s = tf.stats;
+                fullStats << s.id_ << "," << tf.pid() << "," << escapePath(tf.project()->path()) << "," << escapePath(s.relPath()) << "," << escapePath(s.githubUrl()) << "," << s.createdDate << "," << s.bytes() << "," << s.totalTokens << "," << s.uniqueTokens_ << "," << s.tokenBytes_ << "," << s.errors << "," << s.loc_ << "," << s.commentLoc_ << "," << s.emptyLoc_ << "," << s.totalTokens << "," << s.uniqueTokens_ << "," << s.errors << "," << s.fileHash() << "," << s.tokensHash() << std::endl;
+                stats << tf.pid() << "," << s.id_ << "," << escapePath(s.absPath()) << "," << escapePath(s.githubUrl()) << "," << s.fileHash() << "," << s.bytes() << "," << s.loc_ << "," << (s.loc_ - s.emptyLoc_) << "," << (s.loc_ - s.emptyLoc_ - s.commentLoc_) << std::endl;
+                tokens << tf.pid() << "," << s.id_ << "," << s.totalTokens << "," << s.uniqueTokens_ << "," << s.tokensHash() << "@#@";
+                bool first = true;
+                for (auto const & i : tf.ids) {
+                    if (not first)
+                        tokens << ",";
+                    first = false;
+                    tokens << std::hex << i.first << std::dec << "@@::@@" << i.second;
+                }
+                tokens << std::endl;
+            }
+        }
+    }
+
+    void writeBuffers(std::vector<std::unique_ptr<TokenizedFile>> const & files, unsigned repeat, std::string const & dir) {
+        OutputBuffer fullStats;
+        OutputBuffer stats;
+        OutputBuffer tokens;
+        fullStats.open(dir + "/stats-full.txt");
+        stats.open(dir + "/files-stats.txt");
+        tokens.open(dir + "/files-tokens.txt");
+        for (unsigned r = 0; r < repeat; ++r) {
+            for (auto const & tf : files) {
+                tf->stats.writeFullStats(fullStats);
+                tf->stats.writeSourcererStats(stats);
+                tf->writeTokens(tokens);
+            }
+        }
+        fullStats.close();
+        stats.close();
+        tokens.close();
+    }
+
+    size_t outputSize(std::string const & dir) {
+        size_t result = 0;
+        for (char const * file : { "/stats-full.txt", "/files-stats.txt", "/files-tokens.txt" }) {
+            struct stat s;
+            if (stat((dir + file).c_str(), & s) == 0)
+                result += s.st_size;
+        }
+        return result;
+    }
+
+    void writer(std::mt19937 & rng, std::string const & dir) {
+        constexpr unsigned NUM_FILES = 1000;
+        constexpr unsigned REPEAT = 50;
+        GitProject * project = new GitProject("/data/projects/someone/some-project", "https://github.com/someone/some-project.git");
+        // token ids are only set by the merger or read from binary output, so they are written to a binary tokens file and read back
+        std::string idsFile = dir + "/tokens.bin";
+        {
+            OutputBuffer b;
+            b.open(idsFile);
+            b << TOKENS_BINARY_MAGIC;
+            for (unsigned i = 0; i < NUM_FILES; ++i) {
+                unsigned n = 10 + rng() % 100;
+                b.appendVarint(i).appendVarint(n);
+                for (unsigned j = 0; j < n; ++j)
+                    b.appendVarint(1 + rng() % 1000).appendVarint(1 + rng() % 20);
+            }
+            b.close();
+        }
+        TokensReader reader(idsFile);
+        std::vector<std::unique_ptr<TokenizedFile>> files;
+        unsigned fid;
+        TokenIds ids;
+        while (reader.next(fid, ids)) {
+            TokenizedFile * tf = new TokenizedFile(project, STR("src/module" << fid % 37 << "/file" << fid << ".js"));
+            files.push_back(std::unique_ptr<TokenizedFile>(tf));
+            if (fid == 0)
+                tf->setPid(1);
+            tf->setId(FILE_ID_STARTS_AT + fid);
+            tf->ids = ids;
+            tf->stats.createdDate = 1500000000 + fid;
+            tf->stats.totalTokens = rng() % 5000;
+            tf->stats.uniqueTokens_ = ids.size();
+            tf->stats.loc_ = rng() % 1000;
+            tf->stats.commentLoc_ = rng() % 100;
+            tf->stats.emptyLoc_ = rng() % 100;
+            tf->contents.assign(std::string(rng() % 10000, 'x'));
+            tf->updateFileStats(tf->contents);
+            tf->contents.clear();
+            tf->calculateTokensHash();
+        }
+        std::cout << "writer: " << NUM_FILES * REPEAT << " files" << std::endl;
+        double streams = best([&] () {
+            writeStreams(files, REPEAT, dir);
+        });
+        double streamsMBytes = outputSize(dir) / 1e6;
+        double buffers = best([&] () {
+            writeBuffers(files, REPEAT, dir);
+        });
+        double buffersMBytes = outputSize(dir) / 1e6;
+        report("iostreams, std::endl", streamsMBytes / streams, "MB/s");
+        report("OutputBuffer", buffersMBytes / buffers, "MB/s");
+        for (char const * file : { "/stats-full.txt", "/files-stats.txt", "/files-tokens.txt", "/tokens.bin" })
+            unlink((dir + file).c_str());
+    }
+
+    // ring ------------------------------------------------------------------------
+
+    /** Jobs passed through the channel in each run, capacity of the channel and attempts to push to a full channel before parking, as in QueueWorker.
+     */
+    constexpr unsigned RING_JOBS = 2000000;
+    constexpr unsigned RING_CAPACITY = 1024;
+    constexpr unsigned RING_SPIN_LIMIT = 64;
+
+    /** Channel of the workers, the lock-free ring with producers spinning and then parking while it is full and consumers parking while it is empty.
+     */
+    class RingChannel {
+    public:
+        RingChannel():
+            ring_(RING_CAPACITY) {
+        }
+
+        void push(unsigned job) {
+            for (unsigned spins = 0; not ring_.push(job); ++spins) {
+                if (spins < RING_SPIN_LIMIT)
+                    continue;
+                unsigned epoch = notFull_.prepare();
+                if (ring_.push(job)) {
+                    notFull_.cancel();
+                    break;
+                }
+                notFull_.wait(epoch);
+            }
+            notEmpty_.notifyOne();
+        }
+
+        /** Returns false once the channel is closed and empty.
+         */
+        bool pop(unsigned & job) {
+            popped_.clear();
+            while (not ring_.pop(popped_)) {
+                unsigned epoch = notEmpty_.prepare();
+                if (ring_.pop(popped_)) {
+                    notEmpty_.cancel();
+                    break;
+                }
+                if (closed_) {
+                    notEmpty_.cancel();
+                    return false;
+                }
+                notEmpty_.wait(epoch);
+            }
+            notFull_.notifyOne();
+            job = popped_.back();
+            return true;
+        }
+
+        void close() {
+            closed_ = true;
+            notEmpty_.notifyAll();
+        }
+
+    private:
+        Ring<unsigned> ring_;
+        Parking notEmpty_;
+        Parking notFull_;
+        std::atomic_bool closed_{false};
+
+        static thread_local std::vector<unsigned> popped_;
+    };
+
+    thread_local std::vector<unsigned> RingChannel::popped_;
+
+    /** Bounded std::queue guarded by a mutex, with a condition variable for the consumers and one for the producers.
+     */
+    class LockedChannel {
+    public:
+        void push(unsigned job) {
+            std::unique_lock<std::mutex> g(m_);
+            while (jobs_.size() >= RING_CAPACITY)
+                notFull_.wait(g);
+            jobs_.push(job);
+            notEmpty_.notify_one();
+        }
+
+        bool pop(unsigned & job) {
+            std::unique_lock<std::mutex> g(m_);
+            while (jobs_.empty() and not closed_)
+                notEmpty_.wait(g);
+            if (jobs_.empty())
+                return false;
+            job = jobs_.front();
+            jobs_.pop();
+            notFull_.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> g(m_);
+            closed_ = true;
+            notEmpty_.notify_all();
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable notEmpty_;
+        std::condition_variable notFull_;
+        std::queue<unsigned> jobs_;
+        bool closed_ = false;
+    };
+
+    /** Returns the best time of passing RING_JOBS jobs from the producers to the consumers through a fresh channel.
+     */
+    template<typename CHANNEL>
+    double channelTime(unsigned numProducers, unsigned numConsumers) {
+        return best([&] () {
+            CHANNEL channel;
+            std::atomic_uint producing(numProducers);
+            std::vector<std::thread> threads;
+            for (unsigned p = 0; p < numProducers; ++p) {
+                threads.push_back(std::thread([&, p] () {
+                    for (unsigned i = p; i < RING_JOBS; i += numProducers)
+                        channel.push(i);
+                    if (--producing == 0)
+                        channel.close();
+                }));
+            }
+            for (unsigned c = 0; c < numConsumers; ++c) {
+                threads.push_back(std::thread([&] () {
+                    size_t sum = 0;
+                    unsigned job;
+                    while (channel.pop(job))
+                        sum += job;
+                    sink = sum;
+                }));
+            }
+            for (std::thread & t : threads)
+                t.join();
+        });
+    }
+
+    void ring() {
+        std::cout << "ring: " << RING_JOBS << " jobs, capacity " << RING_CAPACITY << std::endl;
+        std::pair<unsigned, unsigned> const configurations[] = { { 1, 1 }, { 4, 4 }, { 8, 8 }, { 16, 16 }, { 4, 16 }, { 16, 4 } };
+        for (auto const & c : configurations) {
+            double locked = channelTime<LockedChannel>(c.first, c.second);
+            double ring = channelTime<RingChannel>(c.first, c.second);
+            report(STR("mutex and condvars, " << c.first << "/" << c.second), RING_JOBS / locked / 1e6, "Mjobs/s");
+            report(STR("ring and parking, " << c.first << "/" << c.second), RING_JOBS / ring / 1e6, "Mjobs/s");
+        }
+    }
+
+    // queue -----------------------------------------------------------------------
+
+    /** Fanout and depth of the tree of jobs, each job scheduling its children for its own stage, as the crawlers schedule subdirectories.
+     */
+    constexpr unsigned QUEUE_FANOUT = 4;
+    constexpr unsigned QUEUE_DEPTH = 9;
+
+    /** Queue limit of both runtimes, above which jobs are processed by the thread scheduling them.
+     */
+    constexpr unsigned QUEUE_LIMIT = 10000;
+
+    /** Work of a single job, short so that the queue is what is measured.
+     */
+    void queueJobWork(unsigned depth) {
+        uint64_t x = depth;
+        for (unsigned i = 0; i < 50; ++i)
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+        sink = x;
+    }
+
+    /** Job of the tree, of a distinct type for each number of threads, so that each gets its own stage of fresh workers.
+     */
+    template<unsigned THREADS>
+    struct TreeJob {
+        unsigned depth;
+
+        friend std::ostream & operator << (std::ostream & s, TreeJob const & job) {
+            s << job.depth;
+            return s;
+        }
+    };
+
+    template<unsigned THREADS>
+    class TreeWorker : public QueueWorker<TreeJob<THREADS>> {
+    public:
+        TreeWorker(unsigned index):
+            QueueWorker<TreeJob<THREADS>>(STR("TREE " << index)) {
+        }
+
+        static void initializeWorkers() {
+            QueueWorker<TreeJob<THREADS>>::SetQueueLimit(QUEUE_LIMIT);
+            for (unsigned i = 0; i < THREADS; ++i) {
+                std::thread t([i] () {
+                    TreeWorker w(i);
+                    w();
+                });
+                t.detach();
+            }
+        }
+
+    private:
+        void process(TreeJob<THREADS> const & job) override {
+            queueJobWork(job.depth);
+            if (job.depth > 0)
+                for (unsigned i = 0; i < QUEUE_FANOUT; ++i)
+                    this->schedule(TreeJob<THREADS>{job.depth - 1});
+        }
+    };
+
+    /** The queue of a stage before the channels and the deques, a single mutex guarded std::queue with a condition variable for the workers and one for the producers.
+     */
+    class LockedQueuePool {
+    public:
+        LockedQueuePool(unsigned numThreads) {
+            for (unsigned i = 0; i < numThreads; ++i)
+                threads_.push_back(std::thread([this] () {
+                    run();
+                }));
+        }
+
+        ~LockedQueuePool() {
+            {
+                std::lock_guard<std::mutex> g(m_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (std::thread & t : threads_)
+                t.join();
+        }
+
+        void Schedule(unsigned depth) {
+            std::unique_lock<std::mutex> g(m_);
+            while (jobs_.size() > QUEUE_LIMIT)
+                canAdd_.wait(g);
+            jobs_.push(depth);
+            cv_.notify_one();
+        }
+
+        void waitForFinished() {
+            std::unique_lock<std::mutex> g(m_);
+            while (not jobs_.empty() or active_ > 0)
+                done_.wait(g);
+        }
+
+    private:
+        /** Processes the job in the current thread if the queue is full, as the workers did.
+         */
+        void schedule(unsigned depth) {
+            std::unique_lock<std::mutex> g(m_);
+            if (jobs_.size() >= QUEUE_LIMIT) {
+                g.unlock();
+                process(depth);
+                return;
+            }
+            jobs_.push(depth);
+            cv_.notify_one();
+        }
+
+        void process(unsigned depth) {
+            // the workers format every job for the log
+            Worker::Log(STR(depth));
+            queueJobWork(depth);
+            if (depth > 0)
+                for (unsigned i = 0; i < QUEUE_FANOUT; ++i)
+                    schedule(depth - 1);
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> g(m_);
+            while (true) {
+                while (jobs_.empty() and not stop_)
+                    cv_.wait(g);
+                if (stop_)
+                    return;
+                unsigned depth = jobs_.front();
+                jobs_.pop();
+                if (jobs_.size() < QUEUE_LIMIT)
+                    canAdd_.notify_all();
+                ++active_;
+                g.unlock();
+                process(depth);
+                g.lock();
+                if (--active_ == 0 and jobs_.empty())
+                    done_.notify_all();
+            }
+        }
+
+        std::mutex m_;
+        std::condition_variable cv_;
+        std::condition_variable canAdd_;
+        std::condition_variable done_;
+        std::queue<unsigned> jobs_;
+        unsigned active_ = 0;
+        bool stop_ = false;
+        std::vector<std::thread> threads_;
+    };
+
+    template<unsigned THREADS>
+    void queueThreads(unsigned numJobs) {
+        double locked;
+        {
+            LockedQueuePool pool(THREADS);
+            locked = best([&] () {
+                pool.Schedule(QUEUE_DEPTH);
+                pool.waitForFinished();
+            });
+        }
+        // workers cannot be stopped, they park once the tree is done
+        TreeWorker<THREADS>::initializeWorkers();
+        double stealing = best([&] () {
+            QueueWorker<TreeJob<THREADS>>::Schedule(TreeJob<THREADS>{QUEUE_DEPTH});
+            while (not Worker::WaitForFinished(1000)) {
+            }
+        });
+        report(STR("mutex and condvar, " << THREADS << " threads"), numJobs / locked / 1e3, "kjobs/s");
+        report(STR("work stealing, " << THREADS << " threads"), numJobs / stealing / 1e3, "kjobs/s");
+    }
+
+    void queue() {
+        unsigned numJobs = 0;
+        for (unsigned level = 0, n = 1; level <= QUEUE_DEPTH; ++level, n *= QUEUE_FANOUT)
+            numJobs += n;
+        std::cout << "queue: " << numJobs << " jobs" << std::endl;
+        queueThreads<8>(numJobs);
+        queueThreads<16>(numJobs);
+        queueThreads<32>(numJobs);
+        queueThreads<64>(numJobs);
+    }
+
+    // crawler ---------------------------------------------------------------------
+
+    /** Creates a tree of directories with given fanout and depth, each with a few files. Returns the number of directories.
+     */
+    unsigned createTree(std::string const & path, unsigned fanout, unsigned depth) {
+        if (mkdir(path.c_str(), 0755) != 0)
+            throw STR("Unable to create directory " << path);
+        for (unsigned i = 0; i < 2; ++i)
+            std::ofstream(STR(path << "/file" << i << ".js"));
+        unsigned result = 1;
+        if (depth > 0)
+            for (unsigned i = 0; i < fanout; ++i)
+                result += createTree(STR(path << "/dir" << i), fanout, depth - 1);
+        return result;
+    }
+
+    /** The crawler before getdents64, listing with readdir, lstat'ing every entry and opening .git/config of each directory.
+     */
+    void crawlReaddir(std::string const & path) {
+        std::ifstream config(path + "/.git/config");
+        if (config.good())
+            return;
+        DIR * d = opendir(path.c_str());
+        if (d == nullptr)
+            throw STR("Unable to open directory " << path);
+        std::vector<std::string> subdirs;
+        struct dirent * ent;
+        while ((ent = readdir(d)) != nullptr) {
+            if (strcmp(ent->d_name, ".") == 0 or strcmp(ent->d_name, "..") == 0 or strcmp(ent->d_name, ".git") == 0)
+                continue;
+            std::string p = path + "/" + ent->d_name;
+            struct stat s;
+            if (lstat(p.c_str(), & s) == 0 and S_ISDIR(s.st_mode))
+                subdirs.push_back(p);
+        }
+        closedir(d);
+        for (std::string const & p : subdirs)
+            crawlReaddir(p);
+    }
+
+    void crawler(std::string const & dir) {
+        std::string root = dir + "/tree";
+        unsigned numDirs = createTree(root, 4, 7);
+        std::cout << "crawler: " << numDirs << " directories" << std::endl;
+        double readdir = best([&] () {
+            crawlReaddir(root);
+        });
+        report("readdir and lstat, 1 thread", numDirs / readdir, "dirs/s");
+        Crawler::SetQueueLimit(10000);
+        unsigned numCrawlers = 0;
+        for (unsigned numThreads : { 1, 8 }) {
+            // crawlers cannot be stopped, so they are only added
+            Crawler::initializeWorkers(numThreads - numCrawlers);
+            numCrawlers = numThreads;
+            double t = best([&] () {
+                Crawler::Schedule(CrawlerJob(root));
+                while (not Worker::WaitForFinished(1000)) {
+                }
+            });
+            report(STR("Crawler, " << numThreads << " threads"), numDirs / t, "dirs/s");
+        }
+        nftw(root.c_str(), [] (char const * path, struct stat const *, int, struct FTW *) {
+            return remove(path);
+        }, 64, FTW_DEPTH | FTW_PHYS);
+    }
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    std::vector<std::string> sections(argv + 1, argv + argc);
+    if (sections.empty())
+        sections = { "dictionary", "tokenmap", "js", "hash", "writer", "ring", "queue", "crawler" };
+    char dirTemplate[] = "/tmp/tokenizer-bench-XXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr) {
+        std::cerr << "Unable to create temporary directory" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string dir = dirTemplate;
+    std::mt19937 rng(42);
+    try {
+        for (std::string const & arg : sections) {
+            // a section may be given its input after =
+            size_t eq = arg.find('=');
+            std::string section = arg.substr(0, eq);
+            std::string input = eq == std::string::npos ? "" : arg.substr(eq + 1);
+            if (section == "dictionary")
+                dictionary(rng);
+            else if (section == "tokenmap")
+                tokenMap(rng, input);
+            else if (section == "js")
+                js();
+            else if (section == "hash")
+                hash(rng, input);
+            else if (section == "writer")
+                writer(rng, dir);
+            else if (section == "ring")
+                ring();
+            else if (section == "queue")
+                queue();
+            else if (section == "crawler")
+                crawler(dir);
+            else
+                throw STR("Unknown section " << section);
+        }
+    } catch (std::string const & e) {
+        std::cerr << e << std::endl;
+        rmdir(dir.c_str());
+        return EXIT_FAILURE;
+    }
+    rmdir(dir.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../src/parking.h"
+#include "../src/ring.h"
+
+/** Stress test of the ring and parking the workers' queues are built from.
+
+  Producers push numbered jobs into a small ring, parking while it is full, and consumers pop them, parking while it is empty, so that the ring keeps wrapping around, fills up and both sides park and are woken all the time. Every job must be consumed exactly once, each consumer must see the jobs of each producer in the order they were pushed, and every job the ring copied must be destroyed.
+ */
+
+namespace {
+
+    std::atomic<long> live(0);
+
+    /** Job which counts its live copies, so that values lost or destroyed twice by the ring show up.
+     */
+    struct Job {
+        unsigned producer;
+        unsigned index;
+
+        Job(unsigned producer, unsigned index):
+            producer(producer),
+            index(index) {
+            ++live;
+        }
+
+        Job(Job const & other):
+            producer(other.producer),
+            index(other.index) {
+            ++live;
+        }
+
+        ~Job() {
+            --live;
+        }
+    };
+
+    bool failed = false;
+
+    void check(bool condition, char const * what) {
+        if (not condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failed = true;
+        }
+    }
+
+    void stress(unsigned capacity, unsigned numProducers, unsigned numConsumers, unsigned jobsPerProducer) {
+        Ring<Job> ring(capacity);
+        Parking notEmpty;
+        Parking notFull;
+        std::atomic<unsigned> producing(numProducers);
+        std::atomic<bool> done(false);
+        unsigned total = numProducers * jobsPerProducer;
+        std::unique_ptr<std::atomic<unsigned>[]> seen(new std::atomic<unsigned>[total]);
+        for (unsigned i = 0; i < total; ++i)
+            seen[i] = 0;
+        std::atomic<unsigned> outOfOrder(0);
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < numProducers; ++p) {
+            threads.push_back(std::thread([&, p] () {
+                for (unsigned i = 0; i < jobsPerProducer; ++i) {
+                    Job job(p, i);
+                    while (not ring.push(job)) {
+                        unsigned epoch = notFull.prepare();
+                        if (ring.push(job)) {
+                            notFull.cancel();
+                            break;
+                        }
+                        notFull.wait(epoch);
+                    }
+                    notEmpty.notifyOne();
+                }
+                // consumers stop once the ring is empty and there is nothing more to come, so that lost jobs are reported instead of waited for
+                if (--producing == 0) {
+                    done = true;
+                    notEmpty.notifyAll();
+                }
+            }));
+        }
+        for (unsigned c = 0; c < numConsumers; ++c) {
+            threads.push_back(std::thread([&] () {
+                std::vector<Job> jobs;
+                std::vector<int> last(numProducers, -1);
+                while (true) {
+                    if (not ring.pop(jobs)) {
+                        unsigned epoch = notEmpty.prepare();
+                        if (not ring.pop(jobs)) {
+                            if (done) {
+                                notEmpty.cancel();
+                                return;
+                            }
+                            notEmpty.wait(epoch);
+                            continue;
+                        }
+                        notEmpty.cancel();
+                    }
+                    notFull.notifyOne();
+                    Job const & job = jobs.back();
+                    ++seen[job.producer * jobsPerProducer + job.index];
+                    if (static_cast<int>(job.index) <= last[job.producer])
+                        ++outOfOrder;
+                    last[job.producer] = job.index;
+                    jobs.clear();
+                }
+            }));
+        }
+        for (std::thread & t : threads)
+            t.join();
+        unsigned lost = 0;
+        unsigned duplicated = 0;
+        for (unsigned i = 0; i < total; ++i) {
+            if (seen[i] == 0)
+                ++lost;
+            else if (seen[i] > 1)
+                ++duplicated;
+        }
+        std::cout << "capacity " << ring.capacity() << ", " << numProducers << " producers, " << numConsumers << " consumers, " << total << " jobs: " << lost << " lost, " << duplicated << " duplicated, " << outOfOrder << " out of order" << std::endl;
+        check(lost == 0, "jobs lost");
+        check(duplicated == 0, "jobs duplicated");
+        check(outOfOrder == 0, "jobs of a producer consumed out of order");
+        check(ring.size() == 0, "ring not empty");
+        check(live == 0, "jobs copied by the ring not destroyed");
+    }
+
+    /** Checks that values left in the ring are destroyed when it is reset, and that the reset ring wraps around again.
+     */
+    void reset() {
+        Ring<Job> ring(4);
+        std::vector<Job> jobs;
+        for (unsigned round = 0; round < 3; ++round) {
+            for (unsigned i = 0; i < 10; ++i) {
+                if (not ring.push(Job(0, i))) {
+                    check(i == ring.capacity(), "ring full before its capacity");
+                    break;
+                }
+            }
+            check(ring.pop(jobs) and jobs.back().index == 0, "first job not popped first");
+            ring.reset(round == 1 ? 8 : 4);
+            check(live == static_cast<long>(jobs.size()), "jobs left in the ring not destroyed by reset");
+            check(not ring.pop(jobs), "ring not empty after reset");
+        }
+        jobs.clear();
+        check(live == 0, "jobs not destroyed");
+    }
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    unsigned jobs = argc > 1 ? std::atoi(argv[1]) : 100000;
+    reset();
+    // capacity 2 keeps the ring full and both sides parking, larger capacities let the producers run ahead
+    for (unsigned capacity : { 2, 16, 1024 }) {
+        stress(capacity, 1, 1, jobs);
+        stress(capacity, 4, 1, jobs / 4);
+        stress(capacity, 1, 4, jobs);
+        stress(capacity, 4, 4, jobs / 4);
+        stress(capacity, 8, 3, jobs / 8);
+    }
+    if (failed)
+        return EXIT_FAILURE;
+    std::cout << "OK" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/data.h"
+#include "../src/tokenizers/generic.h"
+#include "../src/tokenizers/scan.h"
+
+/** Differential test of the scalar, SSSE3 and AVX2 implementations of ByteSet, and of the tokenizers built on them.
+
+  ByteSet::find and skip are compared against a byte by byte search for every start position and every position of the byte they should stop at, so that all offsets within and across the 16 and 32 byte chunks are covered, with the data at various alignments. Sets include those of the tokenizers, bytes >= 0x80 and sets too large for the lookup tables. Then generated sources with long runs of whitespace, comments, literals and non-ASCII bytes are tokenized by the generic tokenizer with each instruction set, including the scalar one, and by a copy of the byte by byte tokenizer it replaced. All must produce identical tokens and statistics. The JavaScript tokenizer is not used by the pipeline and reads past the end of malformed regular expressions, so it only gets the searches of its sets checked.
+
+  Only the instruction sets supported by the cpu are tested.
+ */
+
+namespace {
+
+    typedef ByteSet::Level Level;
+
+    std::vector<Level> levels;
+
+    unsigned failures = 0;
+
+    char const * name(Level level) {
+        switch (level) {
+            case Level::scalar:
+                return "scalar";
+            case Level::ssse3:
+                return "SSSE3";
+            case Level::avx2:
+                return "AVX2";
+        }
+        return "?";
+    }
+
+    void fail(std::string const & what) {
+        if (++failures <= 20)
+            std::cerr << "FAILED: " << what << std::endl;
+    }
+
+    struct TestSet {
+        std::string name;
+        std::vector<char> bytes;
+        ByteSet set;
+        bool contains[256];
+
+        TestSet(std::string const & name, std::initializer_list<char> bytes):
+            name(name),
+            bytes(bytes),
+            set(bytes) {
+            memset(contains, 0, sizeof(contains));
+            for (char c : bytes)
+                contains[static_cast<unsigned char>(c)] = true;
+        }
+
+        size_t find(char const * data, size_t from, size_t size) const {
+            while (from < size and not contains[static_cast<unsigned char>(data[from])])
+                ++from;
+            return from;
+        }
+
+        size_t skip(char const * data, size_t from, size_t size) const {
+            while (from < size and contains[static_cast<unsigned char>(data[from])])
+                ++from;
+            return from;
+        }
+
+        /** A byte that is (or is not) in the set.
+         */
+        char pick(std::mt19937 & rng, bool inSet) const {
+            while (true) {
+                char c = static_cast<char>(rng() & 0xff);
+                if (contains[static_cast<unsigned char>(c)] == inSet)
+                    return c;
+            }
+        }
+    };
+
+    /** Checks find and skip of all instruction sets against the reference for start positions up to given one.
+     */
+    void checkSearches(TestSet const & t, char const * data, size_t size, size_t maxFrom) {
+        for (size_t from = 0; from <= size and from <= maxFrom; ++from) {
+            size_t expectedFind = t.find(data, from, size);
+            size_t expectedSkip = t.skip(data, from, size);
+            for (Level level : levels) {
+                ByteSet::InstructionSet() = level;
+                size_t f = t.set.find(data, from, size);
+                size_t s = t.set.skip(data, from, size);
+                if (f != expectedFind)
+                    fail(STR(t.name << ": " << name(level) << " find from " << from << " of " << size << " returned " << f << " instead of " << expectedFind));
+                if (s != expectedSkip)
+                    fail(STR(t.name << ": " << name(level) << " skip from " << from << " of " << size << " returned " << s << " instead of " << expectedSkip));
+            }
+        }
+        ByteSet::InstructionSet() = levels.back();
+    }
+
+    void testByteSet(TestSet const & t, std::mt19937 & rng) {
+        static constexpr size_t MAX_SIZE = 100;
+        std::vector<char> buffer(MAX_SIZE + 32);
+        for (size_t align : { 0, 1, 7, 15, 16, 31 }) {
+            char * data = buffer.data() + align;
+            // a single stop at every position, for both the find and the skip, searched from every offset within a chunk
+            for (bool inSet : { true, false }) {
+                // the empty set has neither stops nor bytes to skip
+                if (t.bytes.empty())
+                    break;
+                for (size_t size : { MAX_SIZE, static_cast<size_t>(rng() % MAX_SIZE) }) {
+                    for (size_t stop = 0; stop <= size; ++stop) {
+                        for (size_t i = 0; i < size; ++i)
+                            data[i] = t.pick(rng, not inSet);
+                        if (stop < size)
+                            data[stop] = t.pick(rng, inSet);
+                        checkSearches(t, data, size, 32);
+                    }
+                }
+            }
+            // random mixes of bytes in and out of the set
+            for (unsigned density : { 2u, 8u, 64u }) {
+                size_t size = rng() % (MAX_SIZE + 1);
+                for (size_t i = 0; i < size; ++i)
+                    data[i] = t.pick(rng, not t.bytes.empty() and rng() % density == 0);
+                checkSearches(t, data, size, size);
+            }
+        }
+    }
+
+    /** Random set of 16 bytes with given number of distinct ones, drawn from all bytes or from the bytes >= 0x80 only.
+     */
+    TestSet randomSet(std::mt19937 & rng, unsigned index, unsigned distinct, bool high) {
+        char b[16];
+        for (unsigned i = 0; i < 16; ++i)
+            b[i] = i < distinct ? static_cast<char>(high ? 0x80 | (rng() & 0x7f) : rng() & 0xff) : b[i % distinct];
+        return TestSet(STR("random set " << index), { b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15] });
+    }
+
+    /** Generates source code with runs of various lengths, so that the tokens, comments, literals and whitespace start and end at all offsets within the chunks.
+     */
+    std::string generateSource(std::mt19937 & rng) {
+        static char const * fragments[] = {
+            "var", "function", "return", "x", "_$id", "a1b2", "0x1f", "1.5e10", "42",
+            "(", ")", "{", "}", "[", "]", ";", ",", ".", "=", "==", "===", "+", "++", "-", "*", "/", "%", "<", ">>>", "&&", "||", "!", "?", ":", "~", "^", "#", "@",
+            "\"str\\\"ing\"", "'c'", "`tmpl ${x}`", "\"\\\\\"", "/re+g/g",
+            "// line comment", "/* block */", "/* multi\nline\r\n*/", "/**/", "/***/", "/* * / */",
+            "\n", "\r\n", "\r", "\t", " ",
+            "\xc3\xa9t\xc3\xa9", "\xe2\x80\x94", "\xf0\x9f\x98\x80", "\xff", "\x80", "\xa0",
+        };
+        static constexpr size_t NUM_FRAGMENTS = sizeof(fragments) / sizeof(fragments[0]);
+        std::string result;
+        size_t length = rng() % 2000;
+        while (result.size() < length) {
+            switch (rng() % 8) {
+                case 0:
+                    // long runs of whitespace or of identifier characters
+                    result.append(rng() % 80, " \t\nxa\x80"[rng() % 6]);
+                    break;
+                case 1: {
+                    // long comments and literals
+                    std::string body(rng() % 80, 'c');
+                    for (char & c : body)
+                        c = "ab *\n\r\\/\"'\xc3\xa9"[rng() % 12];
+                    char const * open[] = { "/*", "//", "\"", "'", "`" };
+                    char const * close[] = { "*/", "\n", "\"", "'", "`" };
+                    unsigned k = rng() % 5;
+                    result.append(open[k]).append(body).append(close[k]);
+                    break;
+                }
+                case 2:
+                    result.push_back(static_cast<char>(rng() & 0xff));
+                    break;
+                default:
+                    result.append(fragments[rng() % NUM_FRAGMENTS]);
+                    if (rng() % 2)
+                        result.push_back(' ');
+            }
+        }
+        // an archive signature would make the tokenizers throw
+        if (result.compare(0, 2, "PK") == 0)
+            result[0] = ' ';
+        return result;
+    }
+
+    /** The generic tokenizer as it was before the byte set searches, going through the contents byte by byte.
+
+      Kept verbatim, so that the tokenizer with any of the instruction sets must produce exactly the output the tokenizer produced before it used them.
+     */
+    class ReferenceTokenizer {
+    public:
+        static void tokenize(TokenizedFile * f) {
+            ReferenceTokenizer t(f);
+            t.tokenize();
+            f->updateFileStats(t.data_);
+        }
+
+    private:
+        ReferenceTokenizer(TokenizedFile * f):
+            f_(*f),
+            data_(f->contents) {
+        }
+
+        bool eof() {
+            return pos_ >= data_.size();
+        }
+
+        char top() {
+            if (pos_ >= data_.size())
+                return 0;
+            if (data_[pos_] == '\n') {
+                if (peek(1) == '\r') {
+                    data_[pos_ + 1] = '\n';
+                    ++pos_;
+                }
+            } else if (data_[pos_] == '\r') {
+                if (peek(1) == '\n')
+                    ++pos_;
+            }
+            return data_[pos_];
+        }
+
+        void pop(unsigned by = 1) {
+            pos_ += by;
+            if (pos_ > data_.size())
+                pos_ = data_.size();
+        }
+
+        char peek(int offset) {
+            if (pos_ + offset < 0 or pos_ + offset >= data_.size())
+                return 0;
+            return data_[pos_ + offset];
+        }
+
+        void addToken(unsigned start, unsigned length) {
+            if (length > 0) {
+                hasToken_ = true;
+                f_.addToken(TokenView(data_.data() + start, length));
+                f_.stats.tokenBytes_ += length;
+            }
+        }
+
+        void newline() {
+            ++f_.stats.loc_;
+            if (not hasToken_) {
+                if (hasComment_)
+                    ++f_.stats.commentLoc_;
+                else
+                    ++f_.stats.emptyLoc_;
+            }
+            hasComment_ = false;
+            hasToken_ = false;
+        }
+
+        void tokenize() {
+            pos_ = 0;
+            hasComment_ = false;
+            hasToken_ = false;
+            unsigned start = 0;
+            unsigned tokenLength_ = 0;
+            while (not eof()) {
+                if (top() == '/') {
+                    // single line comment
+                    if (peek(1) == '/') {
+                        pop(2);
+                        hasComment_ = true;
+                        while (not eof() and top() != '\n')
+                            pop();
+                    // multi-line comment
+                    } else if (peek(1) == '*') {
+                        pop(2);
+                        hasComment_ = true;
+                        while (not eof()) {
+                            if (top() == '*' and peek(1) == '/')
+                                break;
+                            pop();
+                        }
+                    }
+                }
+                // the comment might have been the last thing
+                if (eof())
+                    break;
+                switch (top()) {
+                    case ';':
+                    case '.':
+                    case '[':
+                    case ']':
+                    case '(':
+                    case ')':
+                    case '~':
+                    case '!':
+                    case '-':
+                    case '+':
+                    case '&':
+                    case '*':
+                    case '/':
+                    case '%':
+                    case '<':
+                    case '>':
+                    case '^':
+                    case '|':
+                    case '?':
+                    case '{':
+                    case '}':
+                    case '=':
+                    case '#':
+                    case ',':
+                    case '"':
+                    case '\\':
+                    case ':':
+                    case '$':
+                    case '\'':
+                    case '\t':
+                    case ' ':
+                    case '\r':
+                    case '\n':
+                        addToken(start, tokenLength_);
+                        if (top() == '\n')
+                            newline();
+                        pop();
+                        start = pos_;
+                        tokenLength_ = 0;
+                        break;
+                    default:
+                        pop();
+                        ++tokenLength_;
+                        break;
+                }
+            }
+            addToken(start, tokenLength_);
+        }
+
+        TokenizedFile & f_;
+        FileBuffer & data_;
+
+        unsigned pos_;
+        bool hasComment_;
+        bool hasToken_;
+    };
+
+    /** Tokenizes the contents and describes the resulting tokens and statistics.
+     */
+    template<typename TOKENIZER>
+    std::string tokenize(std::string const & contents) {
+        TokenizedFile tf;
+        tf.contents.assign(std::string(contents));
+        TOKENIZER::tokenize(& tf);
+        tf.calculateTokensHash();
+        std::vector<std::pair<std::string, unsigned>> tokens;
+        for (auto const & t : tf.tokens)
+            tokens.push_back(std::make_pair(t.first.str(), t.second));
+        std::sort(tokens.begin(), tokens.end());
+        std::stringstream result;
+        result << "tokens " << tf.stats.totalTokens << ", unique " << tf.tokens.size() << ", token bytes " << tf.stats.tokenBytes_ << ", errors " << tf.stats.errors << ", loc " << tf.stats.loc_ << ", comment loc " << tf.stats.commentLoc_ << ", empty loc " << tf.stats.emptyLoc_ << ", bytes " << tf.stats.bytes() << ", hash " << tf.stats.fileHash() << ", tokens hash " << tf.stats.tokensHash() << "\n";
+        for (auto const & t : tokens)
+            result << t.second << " " << t.first << "\n";
+        return result.str();
+    }
+
+    /** Checks the generic tokenizer with each instruction set against the reference tokenizer.
+     */
+    void testGenericTokenizer(std::string const & contents, unsigned index) {
+        std::string expected = tokenize<ReferenceTokenizer>(contents);
+        for (Level level : levels) {
+            ByteSet::InstructionSet() = level;
+            if (tokenize<GenericTokenizer>(contents) != expected)
+                fail(STR("generic tokenizer: " << name(level) << " differs from the byte by byte tokenizer on generated source " << index));
+        }
+        ByteSet::InstructionSet() = levels.back();
+    }
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    unsigned numSources = argc > 1 ? std::atoi(argv[1]) : 2000;
+    // the instruction sets up to the best one the cpu supports
+    for (Level level : { Level::scalar, Level::ssse3, Level::avx2 })
+        if (level <= ByteSet::InstructionSet())
+            levels.push_back(level);
+    std::cout << "instruction sets:";
+    for (Level level : levels)
+        std::cout << " " << name(level);
+    std::cout << std::endl;
+    std::mt19937 rng(42);
+    std::vector<TestSet> sets;
+    sets.push_back(TestSet("generic separators", { ';', '.', '[', ']', '(', ')', '~', '!', '-', '+', '&', '*', '/', '%', '<', '>', '^', '|', '?', '{', '}', '=', '#', ',', '"', '\\', ':', '$', '\'', '\t', ' ', '\r', '\n' }));
+    sets.push_back(TestSet("generic line comment stops", { '\r', '\n' }));
+    sets.push_back(TestSet("generic comment stops", { '*', '\r', '\n' }));
+    sets.push_back(TestSet("js identifier ends", { '\n', '\r', ' ', '\t', '"', '\'', '`', '/', '>', '<', '=', '!', '+', '-', '*', '%', '&', '|', '^', '}', ')', ']', '{', '(', '[', '.', ',', ';', ':', '~', '?', 0 }));
+    sets.push_back(TestSet("js blanks", { ' ', '\t', '\r' }));
+    sets.push_back(TestSet("js line comment ends", { '\n' }));
+    sets.push_back(TestSet("js comment stops", { '*', '\n' }));
+    sets.push_back(TestSet("empty", { }));
+    sets.push_back(TestSet("nul", { 0 }));
+    sets.push_back(TestSet("high bytes", { '\x80', '\xa0', '\xc3', '\xe2', '\xf0', '\xff' }));
+    sets.push_back(TestSet("mixed", { '\x7f', '\x80', '\x0f', '\xf0', ' ', '\xfe' }));
+    // more than 8 groups of high nibbles, searched by the scalar code only
+    sets.push_back(TestSet("too many groups", { '\x00', '\x11', '\x22', '\x33', '\x44', '\x55', '\x66', '\x77', '\x88', '\x99' }));
+    for (unsigned i = 0; i < 24; ++i)
+        sets.push_back(randomSet(rng, i, 1 + i % 16, i % 3 == 0));
+    for (TestSet & t : sets)
+        testByteSet(t, rng);
+    for (unsigned i = 0; i < numSources; ++i) {
+        std::string source = generateSource(rng);
+        testGenericTokenizer(source, i);
+    }
+    if (failures > 0) {
+        std::cerr << failures << " failures" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "OK" << std::endl;
+    return EXIT_SUCCESS;
+}